@@ -0,0 +1,17 @@
+// times lexing runs of n 'a's with the lexer for backtrack.yuno, which takes quadratic time
+// unless it is built with YUNOLEX_LINEAR, see make bench-backtrack
+#include LEXER
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char** argv) {
+    for ( int i = 1; i < argc; i++ ) {
+        std::string input(std::atol(argv[i]), 'a');
+        auto start = std::chrono::steady_clock::now();
+        auto tokens = Lexer::Lexer::lex(std::string_view(input));
+        auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "n = " << input.size() << ": " << tokens.size() << " tokens in " << time << "ms" << std::endl;
+    }
+}
@@ -72,13 +72,11 @@ public:
     Alternation(Node* left, Node* right) : BinaryNode(left, right) {}
 
     [[nodiscard]] Automata* automata() const override {
-        auto n = new Automata(new State(false));
+        auto n = new Automata(false);
         auto left = _left->automata();
         auto right = _right->automata();
-        n->startState()->addEdge(left->startState(), EPS);
-        n->startState()->addEdge(right->startState(), EPS);
-        n->assumeStates(left->states());
-        n->assumeStates(right->states());
+        n->addEdge(n->startState(), left->startState() + n->subsume(left), EPS);
+        n->addEdge(n->startState(), right->startState() + n->subsume(right), EPS);
         delete left;
         delete right;
         return n;
@@ -98,14 +96,15 @@ public:
     Star(Node* body) : UnaryNode(body) {}
 
     [[nodiscard]] Automata* automata() const override {
-        auto n = new Automata(new State(true));
+        auto n = new Automata(true);
         auto body = _body->automata();
-        n->startState()->addEdge(body->startState(), EPS);
-        interfaces::apply<IState*>(body->finstates(), [n](IState* state) -> void {
-            state->addEdge(n->startState(), EPS);
-        });
+        auto fins = body->finstates();
         body->clearFinal();
-        n->assumeStates(body->states());
+        auto offset = n->subsume(body);
+        n->addEdge(n->startState(), body->startState() + offset, EPS);
+        interfaces::apply<std::size_t>(fins, [n, offset](std::size_t state) -> void {
+            n->addEdge(state + offset, n->startState(), EPS);
+        });
         delete body;
         return n;
     }
@@ -143,17 +142,17 @@ public:
     Question(Node* body) : UnaryNode(body) {}
 
     [[nodiscard]] Automata* automata() const override {
-        auto n = new Automata(new State(false));
-        auto end = new State(true);
-        n->assumeState(end);
-        n->startState()->addEdge(end, EPS);
+        auto n = new Automata(false);
+        auto end = n->addState(true);
+        n->addEdge(n->startState(), end, EPS);
         auto body = _body->automata();
-        n->startState()->addEdge(body->startState(), EPS);
-        interfaces::apply<IState*>(body->finstates(), [end](IState* state) -> void {
-            state->addEdge(end, EPS);
-        });
+        auto fins = body->finstates();
         body->clearFinal();
-        n->assumeStates(body->states());
+        auto offset = n->subsume(body);
+        n->addEdge(n->startState(), body->startState() + offset, EPS);
+        interfaces::apply<std::size_t>(fins, [n, offset, end](std::size_t state) -> void {
+            n->addEdge(state + offset, end, EPS);
+        });
         delete body;
         return n;
     }
@@ -175,21 +174,24 @@ public:
     Interval(Node* body, int lower, int upper) : UnaryNode(body), _lower(lower), _upper(upper) {}
 
     [[nodiscard]] Automata* automata() const override {
-        Automata* n = new Automata(new State(true));
+        Automata* n = new Automata(true);
         if ( _upper == 0 ) return n;
         for ( int i = 0; i < _lower; i++ ) {
-            n->concatenateSubsume(_body->automata());
+            auto body = _body->automata();
+            n->concatenateSubsume(body);
+            delete body;
         }
         if ( _lower == _upper ) return n;
         if ( _upper == -1 ) { // infinite upper bound
-            auto n2 = new Automata(new State(true));
+            auto n2 = new Automata(true);
             auto body = _body->automata();
-            n2->startState()->addEdge(body->startState(), EPS);
-            interfaces::apply<IState*>(body->finstates(), [n2](IState* state) -> void {
-                state->addEdge(n2->startState(), EPS);
-            });
+            auto fins = body->finstates();
             body->clearFinal();
-            n2->assumeStates(body->states());
+            auto offset = n2->subsume(body);
+            n2->addEdge(n2->startState(), body->startState() + offset, EPS);
+            interfaces::apply<std::size_t>(fins, [n2, offset](std::size_t state) -> void {
+                n2->addEdge(state + offset, n2->startState(), EPS);
+            });
             delete body;
             n->concatenateSubsume(n2);
             delete n2;
@@ -198,11 +200,13 @@ public:
         auto lmfin = n->finstates();
         for ( int i = 0; i < _upper - _lower; i++ ) {
             auto temp = _body->automata();
-            interfaces::apply<IState*>(lmfin, [temp](IState* state) -> void {
-                state->addEdge(temp->startState(), EPS);
+            auto fins = temp->finstates();
+            auto offset = n->subsume(temp);
+            interfaces::apply<std::size_t>(lmfin, [n, temp, offset](std::size_t state) -> void {
+                n->addEdge(state, temp->startState() + offset, EPS);
             });
-            lmfin = temp->finstates();
-            n->assumeStates(temp->states());
+            lmfin.clear();
+            for ( auto f : fins ) lmfin.push_back(f + offset);
             delete temp;
         }
         return n;
@@ -247,10 +251,9 @@ public:
     ~Symbol() = default;
 
     [[nodiscard]] Automata* automata() const override {
-        auto n = new Automata(new State(false));
-        State* end = new State(true);
-        n->assumeState(end);
-        n->startState()->addEdge(end, _symbol);
+        auto n = new Automata(false);
+        auto end = n->addState(true);
+        n->addEdge(n->startState(), end, _symbol);
         return n;
     }
 
@@ -276,11 +279,10 @@ public:
     }
 
     [[nodiscard]] Automata* automata() const override {
-        auto n = new Automata(new State(false));
-        auto end = new State(true);
-        n->assumeState(end);
+        auto n = new Automata(false);
+        auto end = n->addState(true);
         for ( auto s : _options ) {
-            n->startState()->addEdge(end, s);
+            n->addEdge(n->startState(), end, s);
         }
         return n;
     }
@@ -1,205 +1,349 @@
 #include "automata.h"
+#include "../framework/dbg.h"
+#include <algorithm>
+#include <iostream>
 #include <map>
+#include <unordered_map>
 
 namespace yunolex {
 
+#define DROPPED ((std::size_t)-1)
+
+std::size_t Automata::subsume(Automata* other) {
+    auto offset = _states.size();
+    for ( auto& s : other->_states ) {
+        for ( auto& t : s.Outbound ) t.Dest += offset;
+        _states.push_back(std::move(s));
+    }
+    other->_states.clear();
+    return offset;
+}
+
+std::vector<std::size_t> Automata::finstates() const {
+    std::vector<std::size_t> fins;
+    for ( std::size_t i = 0; i < _states.size(); i++ ) {
+        if ( _states[i].Final ) fins.push_back(i);
+    }
+    return fins;
+}
+
 void Automata::dot(std::ostream& out) const {
     out << "digraph automata" << this << " {\n\ts [shape=none,label=\"\"]\n";
-    for (auto state : *_states) {
-        out << "\t" << state->toString() << " [shape=";
-        if ( state->isFinal() ) out << "double";
+    for ( std::size_t i = 0; i < _states.size(); i++ ) {
+        out << "\t" << stateName(i) << " [shape=";
+        if ( _states[i].Final ) out << "double";
         out << "circle]\n";
     }
-    out << "\ts -> " << _startState->toString() << " []\n";
-    for ( auto state : *_states ) {
-        for ( auto t : state->outbound() ) {
-            auto s = (t->symbol() == "\\" || t->symbol() == "\"") ? "\\" + t->symbol() : t->symbol();
-            out << "\t" << state->toString() << " -> " << t->dest()->toString() << " [label=\"" << s << "\"]\n";
+    out << "\ts -> " << stateName(_startState) << " []\n";
+    for ( std::size_t i = 0; i < _states.size(); i++ ) {
+        for ( auto& t : _states[i].Outbound ) {
+            auto s = (t.Symbol == "\\" || t.Symbol == "\"") ? "\\" + t.Symbol : t.Symbol;
+            out << "\t" << stateName(i) << " -> " << stateName(t.Dest) << " [label=\"" << s << "\"]\n";
         }
     }
     out << "}\n";
 }
 
 void Automata::removeEpsilonTransitions() {
-    interfaces::apply<IState*>(*_states, [](IState* state) -> void {
-        auto eps = state->transitiveReflexiveClosure(true); // get epsilon closure of state
-        for ( auto s : eps ) {
-            for ( auto t : s->outbound() ) {
-                if ( t->getType() == Transition::Type::EPSILON ) { // remove epsilon transitions
-                    state->setFinal(t->dest()->isFinal() || state->isFinal());
-                    state->removeEdge(t);
-                } else if ( s != state && !state->containsEdge(t->dest(), t->symbol()) ) { // dont add duplicate transitions from state
-                    state->addEdge(t->dest(), t->symbol());
+    std::vector<State> states;
+    states.reserve(_states.size());
+    for ( std::size_t i = 0; i < _states.size(); i++ ) {
+        // get epsilon closure of state
+        std::vector<bool> visited(_states.size(), false);
+        std::vector<std::size_t> closure, stack = { i };
+        visited[i] = true;
+        while ( !stack.empty() ) {
+            auto s = stack.back();
+            stack.pop_back();
+            closure.push_back(s);
+            for ( auto& t : _states[s].Outbound ) {
+                if ( t.Symbol == EPS && !visited[t.Dest] ) {
+                    visited[t.Dest] = true;
+                    stack.push_back(t.Dest);
                 }
             }
         }
-    });
+
+        // the state takes over the finality and non-epsilon transitions of its closure
+        State state(false);
+        for ( auto s : closure ) {
+            if ( _states[s].Final ) {
+                state.Final = true;
+                state.Token = std::min(state.Token, _states[s].Token);
+            }
+            for ( auto& t : _states[s].Outbound ) {
+                if ( t.Symbol != EPS && !state.containsEdge(t.Dest, t.Symbol) ) state.Outbound.push_back(t);
+            }
+        }
+        states.push_back(std::move(state));
+    }
+    _states = std::move(states);
     __removeUnreachable();
 }
 
 void Automata::DFAify() {
     removeEpsilonTransitions();
 
-    std::vector<IState*> svec;
-    svec.push_back(_startState);
-    auto startState = new StateSet(svec); // wrap start state in a set
+    // number the symbols, so transitions can be gathered into buckets instead of a map per DFA state
+    std::map<std::string, std::size_t> symbolIds;
+    for ( auto& s : _states ) {
+        for ( auto& t : s.Outbound ) symbolIds.insert({ t.Symbol, 0 });
+    }
+    std::vector<std::string> symbols;
+    for ( auto& sym : symbolIds ) {
+        sym.second = symbols.size();
+        symbols.push_back(sym.first);
+    }
+    std::vector<std::vector<std::pair<std::size_t, std::size_t>>> edges(_states.size());
+    for ( std::size_t i = 0; i < _states.size(); i++ ) {
+        for ( auto& t : _states[i].Outbound ) edges[i].push_back({ symbolIds.at(t.Symbol), t.Dest });
+    }
 
-    auto states = new std::set<IState*>(); // set of the new states that will be generated
-    states->insert(useref(startState));
+    // each set lives once, as a key of `ids`, and `sets` points to them in order of discovery
+    std::unordered_map<StateSet, std::size_t, StateSetHash> ids = { { { _startState }, 0 } }; // wrap start state in a set
+    std::vector<const StateSet*> sets = { &ids.begin()->first };
+    std::vector<State> states; // the new states that will be generated, parallel to sets
+    states.push_back(_states[_startState]);
+    states.back().Outbound.clear();
 
-    __dfaHelp(startState, states);
+    std::vector<StateSet> buckets(symbols.size());
+    std::vector<std::size_t> touched;
+    // sets are numbered in the order they are found, so the next unprocessed one is always the next index
+    for ( std::size_t current = 0; current < sets.size(); current++ ) {
+        // unify all transitions from the members of the current set with the same transition symbol
+        for ( auto s : *sets[current] ) {
+            for ( auto [sym, dest] : edges[s] ) {
+                if ( buckets[sym].empty() ) touched.push_back(sym);
+                buckets[sym].push_back(dest);
+            }
+        }
+        std::sort(touched.begin(), touched.end());
 
-    interfaces::apply<IState*>(*_states, [](IState* s) -> void { freeref(s); });
-    _startState = startState;
-    delete _states;
-    _states = states;
-    _finStates.clear();
-    for ( auto s : *_states ) {
-        if ( s->isFinal() ) _finStates.insert(s);
-    }
-}
+        for ( auto sym : touched ) {
+            auto newset = std::move(buckets[sym]);
+            buckets[sym].clear();
+            std::sort(newset.begin(), newset.end());
+            newset.erase(std::unique(newset.begin(), newset.end()), newset.end());
 
-void Automata::__dfaHelp(StateSet* state, std::set<IState*>* visited) {
-    // unify all transitions from ^^^ with the same transition symbol, also track finality
-    std::map<std::string, std::vector<IState*>> stateprep;
-    // acquire transitions from all IStates in current StateSet
-    auto transitions = state->map<std::set<Transition*>>([](IState* state) -> std::set<Transition*> {
-        return state->outbound(); // using map to expose protected data go brrrr
-    });
-    // populate stateprep
-    for ( auto tset : transitions ) {
-        for ( auto t : tset ) {
-            if ( !stateprep.count(t->symbol()) ) {
-                stateprep.insert({ t->symbol(), std::vector<IState*>() });
+            auto found = ids.find(newset);
+            std::size_t dest;
+            if ( found != ids.end() ) { // if state already exist, use original
+                dest = found->second;
+            } else { // create new state, it accepts the highest priority token of its members
+                dest = sets.size();
+                State newstate(false);
+                for ( auto m : newset ) {
+                    if ( _states[m].Final ) {
+                        newstate.Final = true;
+                        newstate.Token = std::min(newstate.Token, _states[m].Token);
+                    }
+                }
+                sets.push_back(&ids.insert({ std::move(newset), dest }).first->first);
+                states.push_back(std::move(newstate));
             }
-            stateprep.at(t->symbol()).push_back(t->dest());
+            states[current].Outbound.push_back({ symbols[sym], dest });
         }
+        touched.clear();
     }
-    
-    for ( auto trans : stateprep ) {
-        auto newstate = new StateSet(trans.second);
-        if ( auto s = Automata::containsState(*visited, newstate) ) { // if state already exist, use original
-            state->addEdge(s, trans.first);
-            delete newstate;
-        } else { // create new state and recurse
-            state->addEdge(newstate, trans.first);
-            visited->insert(useref(newstate));
-            __dfaHelp(newstate, visited);
-        }
+
+    _states = std::move(states);
+    _startState = 0;
+}
+
+std::size_t Automata::StateSetHash::operator()(const StateSet& set) const {
+    // FNV-1a over the member ids
+    std::size_t hash = 14695981039346656037ull;
+    for ( auto s : set ) {
+        hash ^= s;
+        hash *= 1099511628211ull;
     }
+    return hash;
 }
 
 void Automata::__removeUnreachable() {
-    auto unvis = *_states;
-    __rUHelp(_startState, unvis);
-    for ( auto i : unvis ) {
-        _states->erase(i);
-        if ( _finStates.contains(i) ) _finStates.erase(i);
-        freeref(i);
+    std::vector<std::size_t> ids(_states.size(), DROPPED);
+    std::vector<std::size_t> stack = { _startState };
+    std::size_t count = 0;
+    ids[_startState] = count++;
+    while ( !stack.empty() ) {
+        auto s = stack.back();
+        stack.pop_back();
+        for ( auto& t : _states[s].Outbound ) {
+            if ( ids[t.Dest] == DROPPED ) {
+                ids[t.Dest] = count++;
+                stack.push_back(t.Dest);
+            }
+        }
     }
+    __renumber(ids, count);
 }
 
-void Automata::__rUHelp(IState* state, std::set<IState*>& unvisited) {
-    unvisited.erase(state);
+void Automata::__renumber(std::vector<std::size_t>& ids, std::size_t count) {
+    std::vector<State> states;
+    std::vector<bool> filled(count, false);
+    states.reserve(count);
+    for ( std::size_t i = 0; i < count; i++ ) states.emplace_back(false);
 
-    for ( auto e : state->outbound() ) {
-        if ( unvisited.contains(e->dest()) ) {
-            __rUHelp(e->dest(), unvisited);
+    // the first state mapped to an id provides its contents, states merged into it are discarded
+    for ( std::size_t i = 0; i < _states.size(); i++ ) {
+        if ( ids[i] == DROPPED || filled[ids[i]] ) continue;
+        filled[ids[i]] = true;
+        auto& state = states[ids[i]];
+        state.Final = _states[i].Final;
+        state.Token = _states[i].Token;
+        for ( auto& t : _states[i].Outbound ) {
+            if ( ids[t.Dest] != DROPPED && !state.containsEdge(ids[t.Dest], t.Symbol) ) {
+                state.Outbound.push_back({ t.Symbol, ids[t.Dest] });
+            }
         }
     }
+    _states = std::move(states);
+    _startState = ids[_startState];
+}
+
+void Automata::label(std::size_t token) {
+    for ( auto& s : _states ) {
+        if ( s.Final ) s.Token = token;
+    }
+}
+
+Automata* Automata::unite(std::vector<Automata*>& automata) {
+    auto n = new Automata(false);
+    for ( auto a : automata ) {
+        auto offset = n->subsume(a);
+        n->addEdge(n->startState(), a->startState() + offset, EPS);
+        delete a;
+    }
+    return n;
 }
 
 void Automata::concatenateSubsume(Automata* other) {
-    interfaces::apply<IState*>(finstates(), [other](IState* state) -> void {
-        state->addEdge(other->startState(), EPS);
-    });
+    auto fins = finstates();
     clearFinal();
-    assumeStates(other->states());
+    auto start = other->startState() + subsume(other);
+    for ( auto f : fins ) addEdge(f, start, EPS);
 }
 
-void Automata::minimize() {
-    bool done;
-    do {
-        done = true;
-
-        std::vector<IState*> states(_states->begin(), _states->end());
-
-        for ( std::size_t i = 0; i < states.size(); i++ ) {
-            for ( std::size_t j = i + 1; j < states.size(); j++ ) {
-                if ( states[i]->semanticallyEquivalent(states[j]) ) {
-                    done = false;
-
-                    // its goin crazy around here parts, remapping incoming edges
-                    for ( auto is : *_states ) {
-                        if ( is == states[j] ) continue;
-                        for ( auto t : is->outbound() ) {
-                            if ( t->dest() == states[j] ) {
-                                is->addEdge(states[i], t->symbol());
-                                is->removeEdge(t);
-                            }
-                        }
-                    }
+MinimizeReport Automata::minimize() {
+    auto begin = std::chrono::steady_clock::now();
+    MinimizeReport report;
+    report.Before = _states.size();
+
+    // number symbols, the implicit dead state gets the last index
+    std::map<std::string, std::size_t> symbols;
+    for ( auto& s : _states ) {
+        for ( auto& t : s.Outbound ) symbols.insert({ t.Symbol, symbols.size() });
+    }
+    const std::size_t dead = _states.size(), n = _states.size() + 1;
 
-                    // remove states[j]
-                    _states->erase(states[j]);
-                    if ( states[j]->isFinal() ) _finStates.erase(states[j]);
-                    freeref(states[j]);
-                    states.erase(states.begin() + j);
-                    j--;
+    // inverse transitions, grouped by destination, with missing transitions going to the dead state
+    std::vector<std::vector<std::pair<std::size_t, std::size_t>>> inverse(n);
+    for ( std::size_t i = 0; i < dead; i++ ) {
+        std::vector<bool> present(symbols.size(), false);
+        for ( auto& t : _states[i].Outbound ) {
+            auto sym = symbols.at(t.Symbol);
+            present[sym] = true;
+            inverse[t.Dest].push_back({ sym, i });
+        }
+        for ( std::size_t sym = 0; sym < symbols.size(); sym++ ) {
+            if ( !present[sym] ) inverse[dead].push_back({ sym, i });
+        }
+    }
+    for ( std::size_t sym = 0; sym < symbols.size(); sym++ ) inverse[dead].push_back({ sym, dead });
+
+    // blocks are contiguous ranges of `elems`, marked members are moved to the front of their block
+    std::vector<std::size_t> elems(n), location(n), blockOf(n);
+    std::vector<Block> blocks;
+    {
+        // initial partition by accepted token, everything non-accepting shares a block with the dead state
+        std::map<std::pair<bool, std::size_t>, std::vector<std::size_t>> initial;
+        for ( std::size_t i = 0; i < dead; i++ ) {
+            initial[{ _states[i].Final, _states[i].Token }].push_back(i);
+        }
+        initial[{ false, NOTOKEN }].push_back(dead);
+        std::size_t pos = 0;
+        for ( auto& group : initial ) {
+            blocks.push_back({ pos, pos + group.second.size(), 0 });
+            for ( auto i : group.second ) {
+                elems[pos] = i;
+                location[i] = pos++;
+                blockOf[i] = blocks.size() - 1;
+            }
+        }
+    }
+
+    std::vector<std::size_t> work;
+    std::vector<bool> inWork(blocks.size(), true);
+    for ( std::size_t b = 0; b < blocks.size(); b++ ) work.push_back(b);
+
+    std::vector<std::vector<std::size_t>> preimage(symbols.size());
+    while ( !work.empty() ) {
+        auto splitter = work.back();
+        work.pop_back();
+        inWork[splitter] = false;
+
+        for ( auto& p : preimage ) p.clear();
+        for ( auto i = blocks[splitter].Begin; i < blocks[splitter].End; i++ ) {
+            for ( auto [sym, src] : inverse[elems[i]] ) preimage[sym].push_back(src);
+        }
+
+        for ( auto& pre : preimage ) {
+            std::vector<std::size_t> touched;
+            for ( auto s : pre ) {
+                auto& b = blocks[blockOf[s]];
+                auto pos = location[s];
+                if ( pos < b.Begin + b.Marked ) continue; // already marked
+                if ( b.Marked == 0 ) touched.push_back(blockOf[s]);
+                auto swap = elems[b.Begin + b.Marked];
+                std::swap(elems[pos], elems[b.Begin + b.Marked]);
+                location[swap] = pos;
+                location[s] = b.Begin + b.Marked++;
+            }
+
+            for ( auto t : touched ) {
+                auto& b = blocks[t];
+                if ( b.Marked == b.End - b.Begin ) {
+                    b.Marked = 0;
+                    continue;
+                }
+                // split the marked prefix off into its own block
+                Block split = { b.Begin, b.Begin + b.Marked, 0 };
+                b.Begin += b.Marked;
+                b.Marked = 0;
+                auto nb = blocks.size();
+                for ( auto i = split.Begin; i < split.End; i++ ) blockOf[elems[i]] = nb;
+                blocks.push_back(split);
+
+                // only the smaller half needs to be a splitter, unless the original still is one
+                if ( inWork[t] || split.End - split.Begin <= blocks[t].End - blocks[t].Begin ) {
+                    work.push_back(nb);
+                    inWork.push_back(true);
+                } else {
+                    work.push_back(t);
+                    inWork[t] = true;
+                    inWork.push_back(false);
                 }
             }
         }
+    }
 
-        // for ( auto s1 : *_states ) {
-        //     for ( auto s2 : *_states ) {
-        //         if ( s2 == _startState || s1 == s2 || (s1 < s2 && s1 != _startState) ) continue;
-        //         if ( s1->semanticallyEquivalent(s2) ) {
-        //             done = false;
-
-        //             // its goin crazy around here parts, remapping incoming edges
-        //             for ( auto is : *_states ) {
-        //                 if ( is == s2 ) continue;
-        //                 for ( auto t : is->outbound() ) {
-        //                     if ( t->dest() == s2 ) {
-        //                         is->addEdge(s1, t->symbol());
-        //                         is->removeEdge(t);
-        //                     }
-        //                 }
-        //             }
-
-        //             // remove s2
-        //             _states->erase(s2);
-        //             if ( s2->isFinal() ) _finStates.erase(s2);
-        //             freeref(s2);
-        //         }
-        //     }
-        // }
-    } while ( !done );
-}
+    // one state per block, numbered from the start state on; states that can never accept are dropped
+    std::vector<std::size_t> blockIds(blocks.size(), DROPPED), ids(dead, DROPPED);
+    std::size_t count = 0;
+    blockIds[blockOf[_startState]] = count++;
+    for ( std::size_t i = 0; i < dead; i++ ) {
+        if ( blockOf[i] == blockOf[dead] ) continue;
+        if ( blockIds[blockOf[i]] == DROPPED ) blockIds[blockOf[i]] = count++;
+        ids[i] = blockIds[blockOf[i]];
+    }
+    ids[_startState] = 0;
+    __renumber(ids, count);
 
-// void Automata::__removeDead() {
-//     auto states = *_states;
-//     for ( auto s : states ) {
-//         auto trc = s->transitiveReflexiveClosure(false);
-//         bool canReachFinal = false;
-//         for ( auto f : trc ) {
-//             if ( f->isFinal() ) {
-//                 canReachFinal = true;
-//                 break;
-//             }
-//         } 
-//         if ( !canReachFinal ) {
-//             for ( auto j : *_states ) {
-//                 for ( auto e : j->outbound() ) {
-//                     if ( e->dest() == s ) {
-//                         j->removeEdge(e);
-//                     }
-//                 }
-//             }
-//             _states->erase(s);
-//             freeref(s);
-//         }
-//     }
-// }
+    report.After = _states.size();
+    report.Time = std::chrono::steady_clock::now() - begin;
+    info(std::cout, "Minimized " + toString() + " from " + std::to_string(report.Before) + " states in "
+        + std::to_string(std::chrono::duration<double, std::milli>(report.Time).count()) + "ms", true);
+    return report;
+}
 
 }
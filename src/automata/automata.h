@@ -1,6 +1,7 @@
 #ifndef YUNOLEX_DFA_H
 #define YUNOLEX_DFA_H
 
+#include <chrono>
 #include <functional>
 #include <ostream>
 #include "../framework/interfaces.h"
@@ -8,84 +9,104 @@
 
 namespace yunolex {
 
+// how much minimization shrunk an automaton, and how long it took
+struct MinimizeReport {
+    std::size_t Before, After;
+    std::chrono::steady_clock::duration Time;
+};
+
 class Automata : public interfaces::Stringable, public interfaces::Reference {
 public:
-    explicit Automata(IState* start) : _startState(start), _states(new std::set<IState*>()) {
-        assumeState(_startState);
+    // creates an automaton containing only its start state
+    explicit Automata(bool startFinal) : _startState(0) {
+        _states.emplace_back(startFinal);
     }
 
-    ~Automata() {
-        interfaces::apply<IState*>(*_states, [](IState* s) -> void { freeref(s); });
-        delete _states;
-    }
+    // a separate copy, registered as a reference of its own
+    Automata(const Automata& other) : _startState(other._startState), _states(other._states) {}
 
-    void assumeStates(std::set<IState*>* states) {
-        _states->merge(*states);
-        interfaces::apply<IState*>(*_states, [this](IState* state) -> void {
-            if ( state->isFinal() ) this->_finStates.insert(state);
-        });
-    }
+    ~Automata() = default;
 
-    void assumeState(IState* state) {
-        _states->insert(useref(state));
-        if ( state->isFinal() ) _finStates.insert(state);
+    std::size_t addState(bool fin) {
+        _states.emplace_back(fin);
+        return _states.size() - 1;
     }
 
-    [[nodiscard]] static IState* containsState(std::set<IState*>& states, IState* state) {
-        for (auto s : states) {
-            if (*s == *state) return s;
-        }
-        return nullptr;
+    void addEdge(std::size_t src, std::size_t dest, std::string sym) {
+        if ( _states[src].containsEdge(dest, sym) ) return;
+        _states[src].Outbound.push_back({ std::move(sym), dest });
     }
 
-    template <typename T>
-    [[nodiscard]] std::set<T> map(std::function<T(IState*)> callback) {
-        std::set<T> nstates;
-        for (auto s : *_states) {
-            nstates.insert(callback(s));
-        }
-        return nstates;
-    }
+    // moves the states of another automaton into this one (invalidates input automaton)
+    // returns the offset that was added to the ids of the moved states
+    std::size_t subsume(Automata* other);
 
     void clearFinal() {
-        interfaces::apply<IState*>(_finStates, [](IState* s) -> void { s->setFinal(false); });
-        _finStates.clear();
+        for ( auto& s : _states ) s.Final = false;
     }
 
-    [[nodiscard]] IState* startState() const { return _startState; }
+    [[nodiscard]] std::size_t startState() const { return _startState; }
+
+    [[nodiscard]] const std::vector<State>& states() const { return _states; }
+
+    [[nodiscard]] const State& state(std::size_t id) const { return _states[id]; }
 
-    [[nodiscard]] std::set<IState*>* states() const { return _states; }
+    [[nodiscard]] std::vector<std::size_t> finstates() const;
 
-    [[nodiscard]] std::set<IState*> finstates() const { return _finStates; }
+    // accepting states that can't be left, so no longer match is possible once they are reached
+    // (minimize() removes every state that can't reach an accepting state, so these are all of them)
+    [[nodiscard]] bool terminal(std::size_t id) const { return _states[id].Final && _states[id].Outbound.empty(); }
+
+    // states are only named for humans, e.g. in dot output
+    [[nodiscard]] static std::string stateName(std::size_t id) { return "q" + std::to_string(id); }
 
     // creates dot file graphviz output
     void dot(std::ostream& out) const;
 
     void removeEpsilonTransitions();
 
-    // Banishes nondeterminism
+    // Banishes nondeterminism, using a worklist subset construction
     void DFAify();
 
-    void minimize();
+    // Hopcroft's partition refinement, starting from a partition by accepted token
+    // states that can never reach an accepting state are removed
+    MinimizeReport minimize();
+
+    // marks every final state as accepting the given token
+    void label(std::size_t token);
+
+    // creates an automaton accepting the union of the input automata (invalidates input automata)
+    // on overlapping matches, the automaton with the lowest token label wins
+    [[nodiscard]] static Automata* unite(std::vector<Automata*>&);
 
     // concatenates automata (invalidates input automata)
     void concatenateSubsume(Automata*);
 
     std::string toString() const override {
-        return "Automata<states: " + std::to_string(_states->size()) + ">";
+        return "Automata<states: " + std::to_string(_states.size()) + ">";
     }
 
 protected:
-    IState* _startState;
-    std::set<IState*>* _states; // maybe create reduceToStateSet??? useful for combining automata?
-    std::set<IState*> _finStates;
+    std::size_t _startState;
+    std::vector<State> _states;
 private:
-    void __dfaHelp(StateSet*, std::set<IState*>*);
+    // range of the partition refinement's element array, with the marked members at its front
+    struct Block {
+        std::size_t Begin, End, Marked;
+    };
+
+    // set of NFA states making up a DFA state, sorted by id
+    using StateSet = std::vector<std::size_t>;
+
+    struct StateSetHash {
+        [[nodiscard]] std::size_t operator()(const StateSet&) const;
+    };
+
     void __removeUnreachable();
-    void __rUHelp(IState*, std::set<IState*>&);
-    //void __removeDead(); // This should do nothing because I *believe* its impossible to have dead states
+    // keeps only the states with a new id, renumbering edges and the start state
+    void __renumber(std::vector<std::size_t>&, std::size_t);
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
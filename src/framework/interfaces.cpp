@@ -3,5 +3,6 @@
 namespace interfaces {
 
 std::set<Reference*> Reference::_references = std::set<Reference*>();
+std::mutex Reference::_lock;
 
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <functional>
 #include <type_traits>
 #include <ostream>
+#include <mutex>
 
 namespace interfaces {
 
@@ -59,10 +60,12 @@ namespace interfaces {
     class Reference {
     public:
         Reference() : _count(0) {
+            std::lock_guard<std::mutex> lock(_lock);
             Reference::_references.insert(this);
         }
 
         virtual ~Reference() {
+            std::lock_guard<std::mutex> lock(_lock);
             Reference::_references.erase(this);
         }
 
@@ -81,10 +84,12 @@ namespace interfaces {
         }
 
         [[nodiscard]] static bool exists(Reference* ref) {
+            std::lock_guard<std::mutex> lock(_lock);
             return _references.contains(ref);
         }
 
         static void dump(std::ostream& out) {
+            std::lock_guard<std::mutex> lock(_lock);
             out << "Reference Dump:" << std::endl;
             for ( auto i : _references ) {
                 out << "\t" << dynamic_cast<Stringable*>(i)->toString() << " " << i->_count << std::endl;
@@ -95,6 +100,8 @@ namespace interfaces {
     private:
         std::size_t _count;
         static std::set<Reference*> _references;
+        // objects are created on several threads at once when building automata in parallel
+        static std::mutex _lock;
     };
 
     template <typename T>
@@ -1,32 +1,41 @@
 #ifndef YUNOLEX_LEX_H
 #define YUNOLEX_LEX_H
 
-#include <map>
+#include <bit>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
-#include <set>
+#include <unordered_set>
 #include <istream>
+#include <ostream>
+#include <string_view>
+#include <system_error>
+#include <thread>
 #include <algorithm>
-
-#define OUTERSCOPE "$"
+#include <iterator>
+#include <optional>
+#include <span>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__) && !defined(YUNOLEX_NO_SIMD)
+#include <immintrin.h>
+#endif
 
 namespace Lexer {
 
-struct Automaton {
-    Automaton(std::string token, std::string start, std::map<std::string, std::map<char, std::string>> transitions, 
-        std::set<std::string> fins, std::set<std::string> in, std::set<std::string> enter, std::set<std::string> leave, bool skip, bool error, std::string errormsg) : 
-        _token(std::move(token)), _start(std::move(start)), _current(_start),
-        _transitions(std::move(transitions)), _finalStates(std::move(fins)), _in(std::move(in)), 
-        _enter(std::move(enter)), _leave(std::move(leave)), _dead(false), _skip(skip), _error(error), _errorMsg(errormsg) {}
-    std::string _token, _start, _current;
-    std::map<std::string, std::map<char, std::string>> _transitions;
-    const std::set<std::string> _finalStates;
-    const std::set<std::string> _in;
-    const std::set<std::string> _enter;
-    const std::set<std::string> _leave;
-    bool _dead;
-    const bool _skip, _error;
-    const std::string _errorMsg;
+// set of scopes, bit i stands for tables::scopes[i]
+using ScopeSet = std::uint64_t;
+
+struct TokenInfo {
+    std::string_view Name;
+    // scopes the token can be lexed in, and the scopes lexing it enters and leaves
+    ScopeSet In, Enter, Leave;
+    bool Skip, Error;
+    std::string_view ErrorMsg;
 };
 
 struct Position final {
@@ -55,129 +64,998 @@ private:
     std::string _what;
 };
 
-struct Token {
-    Token(std::string name, std::string lexeme, Position pos) : Name(std::move(name)), Lexeme(std::move(lexeme)), Pos(std::move(pos)) {}
-    std::string Name;
-    std::string Lexeme;
-    Position Pos;
-    friend std::ostream& operator<<(std::ostream& out, Token& token) {
-        out << "[" << token.Name << ", \"" << token.Lexeme << "\", " << token.Pos << "]";
-        return out;
+// a whole file mapped read-only into memory, to lex without copying it
+class MappedFile final {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if ( fd < 0 ) throw std::system_error(errno, std::generic_category(), path);
+        struct stat st;
+        if ( fstat(fd, &st) < 0 ) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), path);
+        }
+        _size = st.st_size;
+        // empty files can't be mapped, but there is nothing to map anyway
+        if ( _size > 0 ) {
+            _data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ( _data == MAP_FAILED ) {
+                int err = errno;
+                close(fd);
+                throw std::system_error(err, std::generic_category(), path);
+            }
+            madvise(_data, _size, MADV_SEQUENTIAL);
+        }
+        close(fd);
     }
-    friend std::ostream& operator<<(std::ostream& out, const Token& token) {
-        out << "[" << token.Name << ", \"" << token.Lexeme << "\", " << token.Pos << "]";
-        return out;
+    ~MappedFile() {
+        if ( _data ) munmap(_data, _size);
     }
-    std::string toString() const {
-        return "[" + Name + ", \"" + Lexeme + "\", " + Pos.toString() + "]";
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] std::string_view view() const { return { (const char*)_data, _size }; }
+private:
+    void* _data = nullptr;
+    std::size_t _size;
+};
+
+// what the lexer does with input no token matches and with error tokens, chosen when generating it:
+// throw a LexError, or make an error token of it and go on,
+// from the next byte (SkipByte) or from the next byte a token can start with (Resync)
+enum class Recovery {
+    Throw,
+    SkipByte,
+    Resync
+};
+
+// where a run of the automaton stopped, and the longest match it found on the way
+struct Scan {
+    // state to resume from, 0 if the automaton died
+    std::size_t Current;
+    // accepted token's index + 1, 0 if nothing was accepted yet
+    std::size_t Token;
+    // position right after the last accepted byte
+    std::size_t Accept;
+};
+
+// bytes in any of the ranges [Lo[i], Hi[i]] keep a state in itself, unless they are one of the Stop bytes
+struct Loop {
+    unsigned char Ranges;
+    unsigned char Lo[4], Hi[4];
+    unsigned char Stops;
+    unsigned char Stop[4];
+    // skip() for this loop, returns the first position in [pos, end) whose byte leaves it
+    std::size_t (*Skip)(const Loop& loop, const unsigned char* input, std::size_t pos, std::size_t end);
+
+    [[nodiscard]] bool contains(unsigned char b) const {
+        for ( unsigned char s = 0; s < Stops; s++ ) {
+            if ( b == Stop[s] ) return false;
+        }
+        for ( unsigned char r = 0; r < Ranges; r++ ) {
+            if ( (unsigned char)(b - Lo[r]) <= (unsigned char)(Hi[r] - Lo[r]) ) return true;
+        }
+        return false;
     }
 };
 
-class ILexer {
-protected:
-    ILexer(std::vector<Automaton*> automata) : _scope(std::set<std::string>()), _automata(std::move(automata)), _bestFit({ 0, { nullptr, nullptr } }), _position(Position(1,1,0,0)), _text(""), _index(0) {
-        _scope.insert(OUTERSCOPE);
-    }
-
-    [[nodiscard]] bool readCharacter(char c) {
-        std::size_t dead = 0, inscope = 0;
-        bool ret = false;
-        _text += c;
-        for ( auto i = _automata.rbegin(); i != _automata.rend(); i++ ) {
-            auto a = *i;
-            
-            std::set<std::string> intersection;
-            std::set_intersection(a->_in.begin(), a->_in.end(), _scope.begin(), _scope.end(), std::inserter(intersection, intersection.begin()));
-
-            if ( intersection.size() == 0 ) continue; // skip machines that aren't in a current scope
-            inscope++;
-
-            if ( !a->_dead && a->_transitions.count(a->_current) && a->_transitions.at(a->_current).count(c) ) {
-                a->_current = a->_transitions.at(a->_current).at(c);
-                if ( a->_finalStates.count(a->_current) ) {
-                    delete _bestFit.second.first;
-                    _bestFit = { _index , { new Token(a->_token, _text, _position), a } };
+// skips bytes of a loop with Ranges ranges and Stops stops, several at a time where possible
+template <unsigned char Ranges, unsigned char Stops>
+inline std::size_t skip(const Loop& loop, const unsigned char* input, std::size_t pos, std::size_t end) {
+#if defined(__AVX2__) && !defined(YUNOLEX_NO_SIMD)
+    // b is in [lo, hi] if b - lo doesn't saturate past hi - lo
+    __m256i lo[Ranges], width[Ranges], stop[Stops + 1];
+    for ( unsigned char r = 0; r < Ranges; r++ ) {
+        lo[r] = _mm256_set1_epi8((char)loop.Lo[r]);
+        width[r] = _mm256_set1_epi8((char)(loop.Hi[r] - loop.Lo[r]));
+    }
+    for ( unsigned char s = 0; s < Stops; s++ ) stop[s] = _mm256_set1_epi8((char)loop.Stop[s]);
+    while ( pos + 32 <= end ) {
+        auto bytes = _mm256_loadu_si256((const __m256i*)(input + pos));
+        auto in = _mm256_setzero_si256();
+        for ( unsigned char r = 0; r < Ranges; r++ ) {
+            auto over = _mm256_subs_epu8(_mm256_sub_epi8(bytes, lo[r]), width[r]);
+            in = _mm256_or_si256(in, _mm256_cmpeq_epi8(over, _mm256_setzero_si256()));
+        }
+        for ( unsigned char s = 0; s < Stops; s++ ) in = _mm256_andnot_si256(_mm256_cmpeq_epi8(bytes, stop[s]), in);
+        auto out = ~(std::uint32_t)_mm256_movemask_epi8(in);
+        if ( out ) return pos + std::countr_zero(out);
+        pos += 32;
+    }
+#elif defined(__SSE2__) && !defined(YUNOLEX_NO_SIMD)
+    // b is in [lo, hi] if b - lo doesn't saturate past hi - lo
+    __m128i lo[Ranges], width[Ranges], stop[Stops + 1];
+    for ( unsigned char r = 0; r < Ranges; r++ ) {
+        lo[r] = _mm_set1_epi8((char)loop.Lo[r]);
+        width[r] = _mm_set1_epi8((char)(loop.Hi[r] - loop.Lo[r]));
+    }
+    for ( unsigned char s = 0; s < Stops; s++ ) stop[s] = _mm_set1_epi8((char)loop.Stop[s]);
+    while ( pos + 16 <= end ) {
+        auto bytes = _mm_loadu_si128((const __m128i*)(input + pos));
+        auto in = _mm_setzero_si128();
+        for ( unsigned char r = 0; r < Ranges; r++ ) {
+            auto over = _mm_subs_epu8(_mm_sub_epi8(bytes, lo[r]), width[r]);
+            in = _mm_or_si128(in, _mm_cmpeq_epi8(over, _mm_setzero_si128()));
+        }
+        for ( unsigned char s = 0; s < Stops; s++ ) in = _mm_andnot_si128(_mm_cmpeq_epi8(bytes, stop[s]), in);
+        auto out = ~(std::uint32_t)_mm_movemask_epi8(in) & 0xFFFF;
+        if ( out ) return pos + std::countr_zero(out);
+        pos += 16;
+    }
+#endif
+    while ( pos < end && loop.contains(input[pos]) ) pos++;
+    return pos;
+}
+
+// newlines in a span of input, and where the last one is
+struct Newlines {
+    std::size_t Count;
+    const char* Last;
+
+    explicit operator bool() const { return Count; }
+};
+
+// memchr skips the bytes between newlines several at a time, short spans like most tokens are quicker to look at byte by byte
+inline Newlines newlines(const char* begin, const char* end) {
+    Newlines found = { 0, nullptr };
+    if ( end - begin < 16 ) {
+        for ( auto p = begin; p < end; p++ ) {
+            if ( *p == '\n' ) {
+                found.Count++;
+                found.Last = p;
+            }
+        }
+        return found;
+    }
+    for ( auto p = begin; (p = (const char*)std::memchr(p, '\n', end - p)); p++ ) {
+        found.Count++;
+        found.Last = p;
+    }
+    return found;
+}
+
+/**
+ * Generated tables, all constexpr so there is nothing to set up at run time
+ * all tokens of every scope are merged into one DFA per scope set, whose accepting states name the winning token
+ * State: narrowest unsigned type that fits every state, state 0 is dead
+ * Terminals: states from this one on accept and have no way out, so runs stop right there
+ * Loops: states below this one loop back to themselves on the bytes in loops, which are skipped in bulk
+ * TokenKind: enum of all tokens, in order of priority
+ * scopes: name of every scope, by bit in a ScopeSet
+ * tokens: token info, in order of priority
+ * recovery: what to do on errors
+ * ScopeSetId: number of a reachable scope set, scope set 0 is the outer scope that lexing starts in
+ * scopeSets: the scopes in every reachable scope set
+ * starts: start state of every reachable scope set
+ * after: scope set after lexing a token, indexed by scope set * Tokens + token
+ * table-driven automata (the default) also have
+ *   classes: maps every byte to its equivalence class
+ *   transitions: next state, indexed by state * Classes + class
+ *   accepting: 0 if the state accepts nothing, otherwise the accepted token's index + 1
+ * direct-coded automata define YUNOLEX_DIRECT and generate scan() instead
+ */
+namespace tables {
+//%TABLES%
+}
+
+#ifndef YUNOLEX_DIRECT
+namespace tables {
+
+// runs the automaton from scan.Current over input[pos, end), returns where it stopped
+inline std::size_t scan(Scan& scan, const unsigned char* input, std::size_t pos, std::size_t end) {
+    State state = scan.Current;
+    while ( pos < end ) {
+        if ( state < Loops ) {
+            auto skipped = loops[state].Skip(loops[state], input, pos, end);
+            if ( skipped != pos ) {
+                pos = skipped;
+                if ( accepting[state] ) {
+                    // the run may have started in this state, so nothing might have been accepted yet
+                    scan.Token = accepting[state];
+                    scan.Accept = pos;
                 }
-            } else {
-                a->_dead = true;
-                dead++;
+                if ( pos == end ) break;
+            }
+        }
+        state = transitions[state * Classes + classes[input[pos]]];
+        if ( state == 0 ) break;
+        pos++;
+        if ( accepting[state] ) {
+            scan.Token = accepting[state];
+            scan.Accept = pos;
+            // nothing longer can match, so don't read on just to find that out
+            if ( state >= Terminals ) {
+                state = 0;
+                break;
+            }
+        }
+    }
+    scan.Current = state;
+    return pos;
+}
+
+}
+#endif
+
+namespace tables {
+
+// features of the spec that cost the lexer work on every token, compiled out when the spec doesn't use them
+inline constexpr bool Scoped = ScopeSets > 1;
+inline constexpr bool Skips = std::any_of(std::begin(tokens), std::end(tokens), [](const TokenInfo& t) { return t.Skip; });
+inline constexpr bool Errors = std::any_of(std::begin(tokens), std::end(tokens), [](const TokenInfo& t) { return t.Error; });
+
+}
+
+using tables::TokenKind;
+
+// kind of the error tokens that input no token matches becomes, when the lexer recovers from errors
+inline constexpr TokenKind ErrorKind = (TokenKind)tables::Tokens;
+
+[[nodiscard]] constexpr std::string_view name(TokenKind kind) {
+    return kind == ErrorKind ? "error" : tables::tokens[(std::size_t)kind].Name;
+}
+
+// plain record of a lexed token, the lexeme itself stays in the input
+struct Token {
+    TokenKind Id;
+    std::size_t Offset, Length;
+#ifndef YUNOLEX_NO_POSITIONS
+    // line (from 1) and column (from 0) of the first byte
+    std::size_t Line, Col;
+#endif
+
+    [[nodiscard]] std::string_view name() const { return Lexer::name(Id); }
+    [[nodiscard]] std::string_view lexeme(std::string_view input) const { return input.substr(Offset, Length); }
+};
+
+// lines (from 1) and columns (from 0) of offsets into an input, e.g. for tokens lexed with YUNOLEX_NO_POSITIONS
+// newlines are indexed only as far as the offsets asked for, so nothing is spent on positions that are never needed
+class Lines final {
+public:
+    explicit Lines(std::string_view input) : _input(input), _indexed(0) {}
+
+    // position of input[begin, end)
+    [[nodiscard]] Position locate(std::size_t begin, std::size_t end) {
+        auto [sLine, sCol] = __at(begin);
+        auto [eLine, eCol] = __at(end);
+        return Position(sLine, eLine, sCol, eCol);
+    }
+
+    [[nodiscard]] Position locate(const Token& token) { return locate(token.Offset, token.Offset + token.Length); }
+private:
+    // line and column of input[offset]
+    [[nodiscard]] std::pair<std::size_t, std::size_t> __at(std::size_t offset) {
+        while ( _indexed < offset ) {
+            auto newline = (const char*)std::memchr(_input.data() + _indexed, '\n', offset - _indexed);
+            if ( !newline ) {
+                _indexed = offset;
+                break;
             }
+            _newlines.push_back(newline - _input.data());
+            _indexed = _newlines.back() + 1;
+        }
+        auto before = std::lower_bound(_newlines.begin(), _newlines.end(), offset) - _newlines.begin();
+        return { before + 1, before ? offset - _newlines[before - 1] - 1 : offset };
+    }
+
+    std::string_view _input;
+    // offsets of the newlines in input[0, _indexed)
+    std::vector<std::size_t> _newlines;
+    std::size_t _indexed;
+};
+
+// an error the lexer recovered from: the error token it lexed, and what was wrong
+struct Diagnostic {
+    Token Error;
+    std::string_view Message;
+};
+
+class ILexer {
+protected:
+    explicit ILexer(std::string_view input) : _input(input), _pos(0), _base(0), _stream(nullptr), _scope(0), _line(1), _col(0), _anchor(0) {}
+    explicit ILexer(std::istream& stream) : ILexer(std::string_view()) { _stream = &stream; }
+
+    // starts over on new input, keeping the memory the lexer already has
+    // everything else is as if the lexer were new, so lexing begins in the outer scope again
+    void restart(std::string_view input, std::istream* stream) {
+        _input = input;
+        _pos = _base = 0;
+        _stream = stream;
+        _buffer.clear();
+        _scope = 0;
+        _line = 1;
+        _col = _anchor = 0;
+        _diagnostics.clear();
+#ifdef YUNOLEX_LINEAR
+        _failed.clear();
+        _trail.clear();
+        _horizon = 0;
+#endif
+    }
+
+    // the buffer grows past this only for tokens that don't fit
+    static constexpr std::size_t BufferSize = 1 << 16;
+
+    // message of the diagnostics for input no token matches
+    static constexpr std::string_view InvalidToken = "Invalid token";
+
+    // whether there is input left, reading more of the stream if needed
+    [[nodiscard]] bool more() { return _pos < _input.size() || refill(); }
+
+    // moves the unlexed input to the front of the buffer and reads as much of the stream as fits behind it
+    // returns false if there was nothing left to read
+    bool refill() {
+        if ( !_stream ) return false;
+        // line counting can't look at bytes once they are dropped
+        advance(_anchor, _pos);
+        _buffer.erase(0, _pos);
+        _base += _pos;
+        _anchor = 0;
+        _pos = 0;
+
+        auto kept = _buffer.size();
+        _buffer.resize(std::max(BufferSize, kept * 2));
+        auto got = _stream->rdbuf()->sgetn(_buffer.data() + kept, _buffer.size() - kept);
+        _buffer.resize(kept + got);
+        _input = _buffer;
+        return got > 0;
+    }
+
+    // lexes the longest token at the current position into token, false if it is skipped
+    [[nodiscard]] bool readToken(Token& token) {
+        Scan scan = { tables::Scoped ? tables::starts[_scope] : tables::starts[0], 0, _pos };
+        auto stop = run(scan, _pos);
+        // the token might go on past the end of the buffer, backtracking stays within it
+        while ( scan.Current != 0 && stop == _input.size() ) {
+            // refill moves the token to the front of the buffer, even if there turns out to be nothing left to read
+            auto base = _base;
+            auto more = refill();
+            stop -= _base - base;
+            scan.Accept -= _base - base;
+            if ( !more ) break;
+            stop = run(scan, stop);
         }
-        if ( dead == inscope ) {
-            if ( _bestFit.second.first == nullptr ) {
-                // TODO: experiment with some kind of recovery
-                throw LexError(_text, &_position);
+        // in push mode the rest of the token may come with the next chunk, the caller sees _pos hasn't moved
+        if ( _partial && scan.Current != 0 ) {
+            _held = scan;
+            return false;
+        }
+#ifdef YUNOLEX_LINEAR
+        remember(scan);
+#endif
+        return take(token, scan, stop);
+    }
+
+    // makes a token of the longest match a finished run found, false if it is skipped
+    [[nodiscard]] bool take(Token& token, const Scan& scan, std::size_t stop) {
+        if ( scan.Token == 0 ) {
+            if constexpr ( tables::recovery == Recovery::Throw ) {
+                // report everything up to and including the byte that killed the automaton
+                auto end = std::min(stop + 1, _input.size());
+                auto position = locate(_pos, end);
+                throw LexError(std::string(_input.substr(_pos, end - _pos)), &position);
             } else {
-                ret = true;
-                if (!_bestFit.second.second->_skip) _tokenStream.push_back(_bestFit.second.first);
-                if (_bestFit.second.second->_error) throw LexError(_bestFit.second.second->_errorMsg, &_position);
-                _index = _bestFit.first;
-                _position = Position(
-                    _bestFit.second.first->Pos.ELine, 
-                    _bestFit.second.first->Pos.ELine, 
-                    _bestFit.second.first->Pos.ECol,
-                    _bestFit.second.first->Pos.ECol
-                );
-                _text = "";
-                for ( auto e : _bestFit.second.second->_enter ) {
-                    if ( !_scope.count(e) ) _scope.insert(e);
+                // the byte no token starts with, or every byte up to where one can start, becomes an error token
+                auto end = _pos + 1;
+                if constexpr ( tables::recovery == Recovery::Resync ) {
+                    while ( true ) {
+                        while ( end < _input.size() && !startsToken(_input[end]) ) end++;
+                        if ( end < _input.size() || !_stream ) break;
+                        // the error may go on in the rest of the stream, refill moves it to the front of the buffer
+                        auto base = _base;
+                        auto more = refill();
+                        end -= _base - base;
+                        if ( !more ) break;
+                    }
+                    // in push mode the error may go on in the next chunk
+                    if ( _partial && end == _input.size() ) {
+                        _held = { 0, 0, _pos };
+                        return false;
+                    }
                 }
-                for ( auto e : _bestFit.second.second->_leave ) {
-                    auto f = _scope.find(e);
-                    if ( f != _scope.end() ) _scope.erase(f);
+                fail(token, end);
+                return true;
+            }
+        }
+
+        auto& info = tables::tokens[scan.Token - 1];
+        if constexpr ( tables::Errors && tables::recovery == Recovery::Throw ) {
+            if ( info.Error ) {
+                auto position = locate(_pos, scan.Accept);
+                throw LexError(std::string(info.ErrorMsg), &position);
+            }
+        }
+        emit(token, (TokenKind)(scan.Token - 1), scan.Accept);
+        if constexpr ( tables::Scoped ) _scope = tables::after[_scope * tables::Tokens + scan.Token - 1];
+        if constexpr ( tables::Errors && tables::recovery != Recovery::Throw ) {
+            // error tokens are kept even if they are also skipped
+            if ( info.Error ) {
+                _diagnostics.push_back({ token, info.ErrorMsg });
+                return true;
+            }
+        }
+        if constexpr ( tables::Skips ) return !info.Skip;
+        return true;
+    }
+
+    // makes input[_pos, end) a token and moves past it
+    void emit(Token& token, TokenKind kind, std::size_t end) {
+        token.Id = kind;
+        token.Offset = _base + _pos;
+        token.Length = end - _pos;
+#ifndef YUNOLEX_NO_POSITIONS
+        token.Line = _line;
+        token.Col = _col;
+        advance(_pos, end);
+#endif
+        _pos = end;
+    }
+
+    // makes input[_pos, end) an error token and records it
+    void fail(Token& token, std::size_t end) {
+        emit(token, ErrorKind, end);
+        _diagnostics.push_back({ token, InvalidToken });
+    }
+
+    // whether any token of the current scope set starts with b
+    [[nodiscard]] bool startsToken(unsigned char b) const {
+        Scan scan = { tables::Scoped ? tables::starts[_scope] : tables::starts[0], 0, 0 };
+        tables::scan(scan, &b, 0, 1);
+        return scan.Current != 0 || scan.Token != 0;
+    }
+
+#ifndef YUNOLEX_LINEAR
+    // runs the automaton from pos to the end of the buffer
+    std::size_t run(Scan& scan, std::size_t pos) {
+        return tables::scan(scan, (const unsigned char*)_input.data(), pos, _input.size());
+    }
+#else
+    // runs the automaton a byte at a time, giving up on (state, position) pairs that are known to fail
+    std::size_t run(Scan& scan, std::size_t pos) {
+        while ( pos < _input.size() ) {
+            auto key = (_base + pos) * tables::States + scan.Current;
+            if ( _failed.count(key) ) {
+                scan.Current = 0;
+                break;
+            }
+            _trail.push_back(key);
+            pos = tables::scan(scan, (const unsigned char*)_input.data(), pos, pos + 1);
+            if ( scan.Current == 0 ) break;
+        }
+        return pos;
+    }
+
+    // nothing the automaton went through after its last accept can lead to a longer match,
+    // so the next tokens don't need to try again (Reps, "Maximal-munch" tokenization in linear time)
+    void remember(const Scan& scan) {
+        auto accept = (_base + scan.Accept) * tables::States;
+        // pairs before the next token's start are never looked at again
+        if ( _horizon < accept ) _failed.clear();
+        for ( auto key : _trail ) {
+            if ( key < accept ) continue;
+            _failed.insert(key);
+            _horizon = std::max(_horizon, key);
+        }
+        _trail.clear();
+    }
+#endif
+
+    // moves the line and column from begin to end, only looking at the newlines in between
+    void advance(std::size_t begin, std::size_t end) {
+        auto line = newlines(_input.data() + begin, _input.data() + end);
+        if ( line ) {
+            _line += line.Count;
+            _col = _input.data() + end - line.Last - 1;
+        } else {
+            _col += end - begin;
+        }
+        _anchor = end;
+    }
+
+    // position of input[begin, end), counted from the last known line and column
+    [[nodiscard]] Position locate(std::size_t begin, std::size_t end) {
+        advance(_anchor, begin);
+        Position position(_line, _line, _col, _col);
+        advance(begin, end);
+        position.ELine = _line;
+        position.ECol = _col;
+        return position;
+    }
+
+    // input left to lex, all of it or the stream's buffer
+    std::string_view _input;
+    std::size_t _pos;
+    // offset of _input in the whole input
+    std::size_t _base;
+
+    std::istream* _stream;
+    std::string _buffer;
+
+    tables::ScopeSetId _scope;
+
+    // line and column of input[_anchor]
+    std::size_t _line, _col, _anchor;
+
+    std::vector<Diagnostic> _diagnostics;
+
+    // whether more input may follow _input that can't be read yet (push mode), and the run that ran out of input then
+    bool _partial = false;
+    Scan _held;
+
+#ifdef YUNOLEX_LINEAR
+    // (position * States + state) pairs that never reach an accepting state, and those of the current run
+    std::unordered_set<std::size_t> _failed;
+    std::vector<std::size_t> _trail;
+    std::size_t _horizon = 0;
+#endif
+};
+
+// lexes input that is pushed to it in chunks of any size, e.g. as they come in from a socket,
+// calling emit(token) for every token as soon as nothing longer can match it
+// the input isn't kept, only a token that spans chunks is copied, so lexeme() works in emit() but not after it
+class PushLexer final : public ILexer {
+public:
+    PushLexer() : ILexer(std::string_view()) { _partial = true; }
+
+    // lexes the tokens that end in chunk, holding on to one that might go on in the next chunk
+    template <typename Emit>
+    void feed(std::span<const char> chunk, Emit&& emit) {
+        std::string_view input(chunk.data(), chunk.size());
+        auto base = _base + _input.size();
+        std::size_t from = 0;
+        if ( !_buffer.empty() && _held.Current == 0 ) {
+            // a held error goes on up to the first byte a token can start with
+            while ( from < input.size() && !startsToken(input[from]) ) from++;
+            _buffer.append(input.substr(0, from));
+            _input = _buffer;
+            if ( from == input.size() ) return;
+            Token token;
+            fail(token, _buffer.size());
+            emit(token);
+            window(input, base, from);
+        } else if ( !_buffer.empty() ) {
+            // go on with the held run, and keep the bytes of its token with the ones before
+            Scan scan = { _held.Current, _held.Token, NoAccept };
+            auto stop = tables::scan(scan, (const unsigned char*)input.data(), 0, input.size());
+            auto held = _buffer.size();
+            if ( scan.Current != 0 ) {
+                _buffer.append(input);
+                _input = _buffer;
+                _held.Current = scan.Current;
+                if ( scan.Accept != NoAccept ) {
+                    _held.Token = scan.Token;
+                    _held.Accept = held + scan.Accept;
                 }
+                return;
             }
-            reset();
+            if ( scan.Accept != NoAccept ) from = scan.Accept;
+            _buffer.append(input.substr(0, from));
+            _input = _buffer;
+            scan.Accept = scan.Accept != NoAccept ? held + scan.Accept : _held.Accept;
+            Token token;
+            if ( take(token, scan, held + stop) ) emit(token);
+            if ( _pos < _buffer.size() ) {
+                // the run backtracked into the buffer, lexing goes on from there, so the rest of the chunk has to follow it
+                _buffer.append(input.substr(from));
+                _input = _buffer;
+                drain(emit);
+                hold();
+                return;
+            }
+            window(input, base, from);
+        } else {
+            window(input, base, 0);
+        }
+        drain(emit);
+        hold();
+    }
+
+    // lexes what is left once the input has ended
+    template <typename Emit>
+    void finish(Emit&& emit) {
+        _partial = false;
+        Token token;
+        if ( !_buffer.empty() ) {
+            if ( take(token, _held, _buffer.size()) ) emit(token);
         }
-        return ret;
+        drain(emit);
+        window(std::string_view(), _base + _input.size(), 0);
+        _buffer.clear();
     }
 
+    // starts over on new input, in the outer scope
     void reset() {
-        for ( auto a: _automata ) {
-            a->_current = a->_start;
-            a->_dead = false;
+        restart(std::string_view(), nullptr);
+        _partial = true;
+    }
+
+    [[nodiscard]] std::string_view lexeme(const Token& token) const { return _input.substr(token.Offset - _base, token.Length); }
+
+    // every error recovered from since the lexer was constructed or reset, in order
+    [[nodiscard]] const std::vector<Diagnostic>& diagnostics() const { return _diagnostics; }
+private:
+    static constexpr std::size_t NoAccept = SIZE_MAX;
+
+    // lexes _input from _pos until it ends or a token might go on past it
+    template <typename Emit>
+    void drain(Emit& emit) {
+        Token token;
+        while ( _pos < _input.size() ) {
+            auto pos = _pos;
+            if ( readToken(token) ) emit(token);
+            else if ( _pos == pos ) break;
         }
-        _bestFit = { _index, { nullptr, nullptr } };
     }
 
-    std::set<std::string> _scope;
-    std::vector<Automaton*> _automata;
-    std::pair<std::size_t, std::pair<Token*, Automaton*>> _bestFit;
-    std::vector<Token*> _tokenStream;
+    // keeps the bytes of the held token, if any, as the buffer to go on from
+    void hold() {
+        advance(_anchor, _pos);
+        auto base = _base + _pos;
+        if ( _pos < _input.size() ) {
+            _held.Accept -= _pos;
+            if ( _input.data() == _buffer.data() ) _buffer.erase(0, _pos);
+            else _buffer.assign(_input.substr(_pos));
+        } else {
+            _buffer.clear();
+        }
+        _input = _buffer;
+        _base = base;
+        _pos = _anchor = 0;
+    }
 
-    Position _position;
-    std::string _text;
-    std::size_t _index;
+    // moves lexing to another part of the input, starting at pos in it
+    void window(std::string_view input, std::size_t base, std::size_t pos) {
+        advance(_anchor, _pos);
+        _input = input;
+        _base = base;
+        _pos = _anchor = pos;
+    }
 };
 
+// lexes input on demand, one token per call to next()
+// tokens refer to the input by offset, so it has to outlive the lexer to read their lexemes
+// streams are read through a buffer instead and never seeked, so they can be pipes or sockets,
+// but lexemes can only be read with lexeme() until the next call to next()
+// the tables are shared and never change, so any number of lexers can run on different threads,
+// and a lexer can be reset to lex something else without allocating anew
 class Lexer final : public ILexer {
 public:
-    [[nodiscard]] static std::vector<Token*> lex(std::istream& file) {
-        Lexer lex;
-
-        while ( file.peek() != -1 ) {
-            char c = file.get();
-            if ( c == '\n' ) {
-                lex._position.ELine++;
-                lex._position.ECol = 0;
-            } else {
-                lex._position.ECol++;
-            }
-            
-            if ( lex.readCharacter(c) ) {
-                file.seekg(lex._index + 1);
+    Lexer() : ILexer(std::string_view()) {}
+    explicit Lexer(std::string_view input) : ILexer(input) {}
+    explicit Lexer(const MappedFile& file) : ILexer(file.view()) {}
+    explicit Lexer(std::istream& stream) : ILexer(stream) {}
+
+    // lexes new input from the outer scope, reusing the buffer
+    void reset(std::string_view input) { restart(input, nullptr); }
+    void reset(const MappedFile& file) { restart(file.view(), nullptr); }
+    void reset(std::istream& stream) { restart(std::string_view(), &stream); }
+
+    // every error recovered from since the lexer was constructed or reset, in order
+    [[nodiscard]] const std::vector<Diagnostic>& diagnostics() const { return _diagnostics; }
+
+    // scopes the lexer is in, as bits naming tables::scopes
+    [[nodiscard]] ScopeSet scopes() const { return tables::scopeSets[_scope]; }
+
+    // next token that isn't skipped, nothing once the input is used up
+    [[nodiscard]] std::optional<Token> next() {
+        Token token;
+        while ( more() ) {
+            if ( readToken(token) ) return token;
+        }
+        return std::nullopt;
+    }
+
+    // fills buffer with the next tokens, returns how many it got, 0 once the input is used up
+    [[nodiscard]] std::size_t next(std::span<Token> buffer) {
+        std::size_t count = 0;
+        while ( count < buffer.size() && more() ) {
+            if ( readToken(buffer[count]) ) count++;
+        }
+        return count;
+    }
+
+    [[nodiscard]] std::string_view lexeme(const Token& token) const { return _input.substr(token.Offset - _base, token.Length); }
+
+    // lets the lexer be used as a C++20 input range, e.g. for ( auto& t : lexer )
+    class Iterator {
+    public:
+        using value_type = Token;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+        explicit Iterator(Lexer* lexer) : _lexer(lexer), _token(lexer->next()) {}
+
+        [[nodiscard]] const Token& operator*() const { return *_token; }
+        [[nodiscard]] const Token* operator->() const { return &*_token; }
+        Iterator& operator++() {
+            _token = _lexer->next();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        [[nodiscard]] bool operator==(std::default_sentinel_t) const { return !_token; }
+    private:
+        Lexer* _lexer = nullptr;
+        std::optional<Token> _token;
+    };
+
+    [[nodiscard]] Iterator begin() { return Iterator(this); }
+    [[nodiscard]] std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    // lexes all of input at once
+    [[nodiscard]] static std::vector<Token> lex(std::string_view input) {
+        std::vector<Diagnostic> diagnostics;
+        return lex(input, diagnostics);
+    }
+
+    // the same, also handing over the errors recovered from, as diagnostics() would give them
+    [[nodiscard]] static std::vector<Token> lex(std::string_view input, std::vector<Diagnostic>& diagnostics) {
+        return __once(input, diagnostics);
+    }
+
+    [[nodiscard]] static std::vector<Token> lex(const MappedFile& file) {
+        return lex(file.view());
+    }
+
+    [[nodiscard]] static std::vector<Token> lex(const MappedFile& file, std::vector<Diagnostic>& diagnostics) {
+        return lex(file.view(), diagnostics);
+    }
+
+    // lexemes of tokens from a stream are gone by the time this returns, only their offsets are left
+    [[nodiscard]] static std::vector<Token> lex(std::istream& stream) {
+        std::vector<Diagnostic> diagnostics;
+        return lex(stream, diagnostics);
+    }
+
+    [[nodiscard]] static std::vector<Token> lex(std::istream& stream, std::vector<Diagnostic>& diagnostics) {
+        return __once(stream, diagnostics);
+    }
+
+    // lexes input in as many chunks as there are threads, all at once
+    // every chunk but the first is lexed on the guess that a token starts right at its beginning, once from every
+    // reachable scope set, since which one the chunk really starts in isn't known until the chunk before it is lexed.
+    // automata tend to fall into step with the real token boundaries quickly, so one of the guesses is usually right
+    // from a few tokens on, and only the tokens before that have to be lexed again
+    [[nodiscard]] static std::vector<Token> lex(std::string_view input, unsigned threads) {
+        std::vector<Diagnostic> diagnostics;
+        return lex(input, threads, diagnostics);
+    }
+
+    [[nodiscard]] static std::vector<Token> lex(std::string_view input, unsigned threads, std::vector<Diagnostic>& diagnostics) {
+        if ( threads <= 1 || input.size() < threads * ChunkSize ) return lex(input, diagnostics);
+
+        std::vector<std::size_t> starts;
+        for ( unsigned c = 0; c <= threads; c++ ) starts.push_back(input.size() / threads * c);
+        starts.back() = input.size();
+
+        std::vector<Chunk> chunks(threads);
+        parallel(threads, [&](unsigned c) { chunks[c].guess(input, starts[c], starts[c + 1], c ? tables::ScopeSets : 1); });
+
+        // continue from where the last chunk really ended until that is a boundary the next chunk guessed too
+        Lexer lex(input);
+        for ( unsigned c = 0; c < threads; c++ ) {
+            auto& chunk = chunks[c];
+            bool stitched = false;
+            Token token;
+            while ( lex._pos < starts[c + 1] ) {
+                if ( !stitched && (stitched = chunk.stitch(lex)) ) continue;
+                if ( lex.readToken(token) ) (stitched ? chunk.After : chunk.Before).push_back(token);
             }
-            lex._index++;
         }
 
-        if ( lex._bestFit.second.first == nullptr ) {
-            throw LexError(lex._text, &lex._position);
-        } else {
-            if (!lex._bestFit.second.second->_skip) lex._tokenStream.push_back(lex._bestFit.second.first);
-            if (lex._bestFit.second.second->_error) throw LexError(lex._bestFit.second.second->_errorMsg, &lex._position);
+        // where every run of tokens goes is known now, so they are copied on all threads at once
+        std::vector<Span> spans;
+        for ( auto& chunk : chunks ) {
+            spans.push_back({ chunk.Before.data(), chunk.Before.size(), 0, 0, 0 });
+            spans.insert(spans.end(), chunk.Taken.begin(), chunk.Taken.end());
+            spans.push_back({ chunk.After.data(), chunk.After.size(), 0, 0, 0 });
         }
+        std::size_t count = 0;
+        for ( auto& span : spans ) {
+            span.At = count;
+            count += span.Count;
+        }
+        std::vector<Token> tokens(count);
+        parallel(threads, [&](unsigned t) {
+            auto begin = count / threads * t, end = t + 1 == threads ? count : count / threads * (t + 1);
+            for ( auto& span : spans ) span.copy(tokens.data(), begin, end);
+        });
+
+        // the guesses recorded errors that may not be real, but every real one is an error token now
+        diagnostics.clear();
+        if constexpr ( tables::recovery != Recovery::Throw ) {
+            for ( auto& token : tokens ) {
+                if ( token.Id == ErrorKind ) diagnostics.push_back({ token, InvalidToken });
+                else if ( tables::Errors && tables::tokens[(std::size_t)token.Id].Error ) diagnostics.push_back({ token, tables::tokens[(std::size_t)token.Id].ErrorMsg });
+            }
+        }
+        return tokens;
+    }
+
+    [[nodiscard]] static std::vector<Token> lex(const MappedFile& file, unsigned threads) {
+        return lex(file.view(), threads);
+    }
 
-        return lex._tokenStream;
+    [[nodiscard]] static std::vector<Token> lex(const MappedFile& file, unsigned threads, std::vector<Diagnostic>& diagnostics) {
+        return lex(file.view(), threads, diagnostics);
     }
 private:
-    Lexer() : ILexer(std::vector<Automaton*>({
\ No newline at end of file
+    // lexes all of source on one lexer per thread for the static lex() functions, reset for every input
+    // the input is only borrowed for the call, so the lexer is left without it or the stream even if lexing throws,
+    // and a buffer grown for a long token is given back instead of staying with the thread
+    template <typename Source>
+    [[nodiscard]] static std::vector<Token> __once(Source&& source, std::vector<Diagnostic>& diagnostics) {
+        thread_local Lexer lex;
+        struct Release {
+            Lexer& Lex;
+            ~Release() {
+                Lex.restart(std::string_view(), nullptr);
+                if ( Lex._buffer.capacity() > BufferSize ) std::string().swap(Lex._buffer);
+            }
+        } release{ lex };
+        lex.reset(source);
+        auto tokens = lex.all();
+        diagnostics = std::move(lex._diagnostics);
+        return tokens;
+    }
+
+    // runs work(0) to work(count - 1), each on a thread of its own
+    template <typename Work>
+    static void parallel(unsigned count, Work&& work) {
+        std::vector<std::thread> workers;
+        for ( unsigned i = 1; i < count; i++ ) workers.emplace_back([&work, i]() { work(i); });
+        work(0);
+        for ( auto& w : workers ) w.join();
+    }
+
+    // inputs smaller than this per thread aren't worth splitting
+    static constexpr std::size_t ChunkSize = 1 << 16;
+
+    // tokens that go to tokens[At, At + Count) of the result, with lines and columns counted from the start of a guess
+    struct Span {
+        const Token* Tokens;
+        std::size_t Count;
+        // lines and columns on the guess's first line are off by as much as came before the guessed start
+        std::size_t Lines, Cols;
+        std::size_t At;
+
+        // copies the part of the span that falls into out[begin, end)
+        void copy(Token* out, std::size_t begin, std::size_t end) const {
+            begin = std::max(begin, At);
+            end = std::min(end, At + Count);
+            for ( auto i = begin; i < end; i++ ) {
+                out[i] = Tokens[i - At];
+#ifndef YUNOLEX_NO_POSITIONS
+                if ( out[i].Line == 1 ) out[i].Col += Cols;
+                out[i].Line += Lines;
+#endif
+            }
+        }
+    };
+
+    // tokens lexed from a guessed start
+    struct Chunk {
+        // a token boundary a guess passed, with the lexer's state there
+        struct Boundary {
+            std::size_t Offset;
+            tables::ScopeSetId Scope;
+            // number of tokens before it
+            std::size_t Tokens;
+#ifndef YUNOLEX_NO_POSITIONS
+            // counted from line 1, column 0 at the guessed start
+            std::size_t Line, Col;
+#endif
+        };
+
+        static constexpr std::size_t NoJoin = SIZE_MAX;
+        // every how many boundaries one is kept
+        static constexpr std::size_t Stride = 16;
+
+        // tokens lexed from the start of the chunk in one scope set
+        struct Guess {
+            std::vector<Token> Tokens;
+            std::vector<Boundary> Boundaries;
+            // the earlier guess this one fell into step with at its last boundary, and that boundary's index in it
+            std::size_t Joins = NoJoin, JoinsAt = 0;
+        };
+
+        std::vector<Guess> Guesses;
+        // what the chunk's tokens are made of: the ones lexed again before and after the guesses took over,
+        // and the runs of guessed tokens taken over
+        std::vector<Token> Before, After;
+        std::vector<Span> Taken;
+
+        // guesses input[begin, end) from each of the first scopes scope sets
+        void guess(std::string_view input, std::size_t begin, std::size_t end, std::size_t scopes) {
+            Guesses.resize(scopes);
+            for ( std::size_t s = 0; s < scopes; s++ ) __guess(input, begin, end, s);
+        }
+
+        // if a guess passed the lexer's position in the same state, takes over its tokens from there
+        // and moves the lexer to where the guesses ended
+        bool stitch(Lexer& lex) {
+            for ( auto& guess : Guesses ) {
+                auto b = std::lower_bound(guess.Boundaries.begin(), guess.Boundaries.end(), lex._pos,
+                    [](const Boundary& b, std::size_t pos) { return b.Offset < pos; });
+                if ( b == guess.Boundaries.end() || b->Offset != lex._pos || b->Scope != lex._scope ) continue;
+
+                std::size_t lines = 0, cols = 0;
+#ifndef YUNOLEX_NO_POSITIONS
+                lines = lex._line - b->Line;
+                cols = lex._col - b->Col;
+#endif
+                // a guess that joined another goes on with that one's tokens
+                auto g = &guess;
+                auto from = b->Tokens;
+                while ( true ) {
+                    Taken.push_back({ g->Tokens.data() + from, g->Tokens.size() - from, lines, cols, 0 });
+                    if ( g->Joins == NoJoin ) break;
+                    from = Guesses[g->Joins].Boundaries[g->JoinsAt].Tokens;
+                    g = &Guesses[g->Joins];
+                }
+
+                auto& last = g->Boundaries.back();
+#ifndef YUNOLEX_NO_POSITIONS
+                lex._col = last.Line == 1 ? last.Col + cols : last.Col;
+                lex._line = last.Line + lines;
+                lex._anchor = last.Offset;
+#endif
+                lex._pos = last.Offset;
+                lex._scope = last.Scope;
+                return true;
+            }
+            return false;
+        }
+
+        // lexes input[begin, end) from scope set scope, up to the first token that ends at or after end,
+        // or until it falls into step with an earlier guess, from where on both would lex the same
+        // a lex error only means the guess was wrong, so it just ends the guess early
+        void __guess(std::string_view input, std::size_t begin, std::size_t end, tables::ScopeSetId scope) {
+            auto& guess = Guesses[scope];
+            Lexer lex(input);
+            lex._pos = lex._anchor = begin;
+            lex._scope = scope;
+            // how far into each earlier guess's boundaries this one has got
+            std::vector<std::size_t> cursors(scope, 0);
+            Token token;
+            for ( std::size_t passed = 0; ; passed++ ) {
+                Boundary here = { lex._pos, lex._scope, guess.Tokens.size(),
+#ifndef YUNOLEX_NO_POSITIONS
+                    lex._line, lex._col,
+#endif
+                };
+                for ( std::size_t g = 0; g < scope && guess.Joins == NoJoin; g++ ) {
+                    auto& other = Guesses[g].Boundaries;
+                    while ( cursors[g] < other.size() && other[cursors[g]].Offset < lex._pos ) cursors[g]++;
+                    if ( cursors[g] < other.size() && other[cursors[g]].Offset == lex._pos && other[cursors[g]].Scope == lex._scope ) {
+                        guess.Joins = g;
+                        guess.JoinsAt = cursors[g];
+                    }
+                }
+                bool last = guess.Joins != NoJoin || lex._pos >= end || lex._pos >= input.size();
+                // the lexer only needs to meet a guess at some boundary, so most don't have to be kept
+                if ( last || passed % Stride == 0 ) guess.Boundaries.push_back(here);
+                if ( last ) break;
+                try {
+                    if ( lex.readToken(token) ) guess.Tokens.push_back(token);
+                } catch ( LexError& ) {
+                    if ( passed % Stride != 0 ) guess.Boundaries.push_back(here);
+                    break;
+                }
+            }
+        }
+    };
+
+    [[nodiscard]] std::vector<Token> all() {
+        std::vector<Token> tokens;
+        Token token;
+        while ( more() ) {
+            if ( readToken(token) ) tokens.push_back(token);
+        }
+        return tokens;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef YUNOLEX_YDFA_H
+#define YUNOLEX_YDFA_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// lexes with tables loaded at run time from a file written by yunolex -b,
+// so lexers can change without recompiling, and processes using the same file share one copy of it in memory
+// slower than a generated lexer, which can narrow its tables and skip loops in bulk
+namespace ydfa {
+
+// format version this runtime reads
+inline constexpr std::uint32_t Version = 2;
+
+/**
+ * File layout, in the byte order of the machine that wrote it
+ * a Header, then the sections it points to, each 8-byte aligned:
+ * transitions: States * ClassCount next states, indexed by state * ClassCount + class, state 0 is dead
+ * accepting: States entries, 0 if the state accepts nothing, otherwise the accepted token's index + 1
+ * tokens: a TokenInfo for every token, in order of priority
+ * scopes: a String for the name of every scope, by bit in a scope set
+ * starts: a Start for every reachable scope set, by its number, the outer scope first
+ * after: the number of the scope set lexing a token leads to, Starts * Tokens entries indexed by scope set * Tokens + token
+ * strings: the characters of every String
+ */
+struct Header {
+    char Magic[4];
+    std::uint32_t Version;
+    // states from Terminals on accept and have no way out
+    std::uint32_t States, ClassCount, Terminals, Tokens, Scopes, Starts;
+    // byte offsets of the sections from the start of the file, and the size of the file
+    std::uint64_t Transitions, Accepting, TokenInfo, ScopeNames, StartStates, After, Strings, Size;
+    // equivalence class of every byte
+    unsigned char Classes[256];
+};
+
+// where a name is in the strings section
+struct String {
+    std::uint32_t Offset, Length;
+};
+
+struct TokenInfo {
+    // scopes the token can be lexed in, and the scopes lexing it enters and leaves
+    std::uint64_t In, Enter, Leave;
+    String Name, ErrorMsg;
+    // 1 if the token is skipped, 2 if it is an error
+    std::uint32_t Flags;
+    std::uint32_t Padding;
+};
+
+struct Start {
+    std::uint64_t Scopes;
+    std::uint32_t State;
+    std::uint32_t Padding;
+};
+
+// a table file mapped read-only into memory
+// it is checked once when loaded, so lexing never reads outside of it even if it is corrupt
+class Tables final {
+public:
+    explicit Tables(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if ( fd < 0 ) throw std::system_error(errno, std::generic_category(), path);
+        struct stat st;
+        if ( fstat(fd, &st) < 0 ) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), path);
+        }
+        _size = st.st_size;
+        if ( _size >= sizeof(Header) ) {
+            _data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+            if ( _data == MAP_FAILED ) {
+                int err = errno;
+                close(fd);
+                throw std::system_error(err, std::generic_category(), path);
+            }
+        }
+        close(fd);
+        if ( !__valid() ) {
+            if ( _data ) munmap(_data, _size);
+            throw std::runtime_error(path + ": not a valid yunolex table file of version " + std::to_string(Version));
+        }
+    }
+
+    ~Tables() {
+        munmap(_data, _size);
+    }
+
+    Tables(const Tables&) = delete;
+    Tables& operator=(const Tables&) = delete;
+
+    [[nodiscard]] const Header& header() const { return *(const Header*)_data; }
+
+    [[nodiscard]] std::uint32_t next(std::uint32_t state, unsigned char b) const {
+        return __section<std::uint32_t>(header().Transitions)[state * header().ClassCount + header().Classes[b]];
+    }
+
+    [[nodiscard]] std::uint32_t accepting(std::uint32_t state) const { return __section<std::uint32_t>(header().Accepting)[state]; }
+
+    [[nodiscard]] const TokenInfo& token(std::uint32_t id) const { return __section<TokenInfo>(header().TokenInfo)[id]; }
+
+    [[nodiscard]] std::string_view name(std::uint32_t id) const { return string(token(id).Name); }
+
+    [[nodiscard]] std::string_view scope(std::uint32_t bit) const { return string(__section<String>(header().ScopeNames)[bit]); }
+
+    [[nodiscard]] std::string_view string(const String& s) const {
+        return { (const char*)_data + header().Strings + s.Offset, s.Length };
+    }
+
+    // scopes and start state of a scope set, by its number
+    [[nodiscard]] const Start& scopeSet(std::uint32_t set) const { return __section<Start>(header().StartStates)[set]; }
+
+    // number of the scope set lexing a token in a scope set leads to
+    [[nodiscard]] std::uint32_t after(std::uint32_t set, std::uint32_t token) const {
+        return __section<std::uint32_t>(header().After)[set * header().Tokens + token];
+    }
+
+    // start state of the automaton for a scope set, by its scopes
+    [[nodiscard]] std::uint32_t start(std::uint64_t scopes) const {
+        auto begin = __section<Start>(header().StartStates), end = begin + header().Starts;
+        auto s = std::find_if(begin, end, [scopes](const Start& s) { return s.Scopes == scopes; });
+        if ( s == end ) throw std::out_of_range("unreachable scope set");
+        return s->State;
+    }
+private:
+    template <typename T>
+    [[nodiscard]] const T* __section(std::uint64_t offset) const { return (const T*)((const char*)_data + offset); }
+
+    // whether a section of count Ts fits between offset and the next section
+    template <typename T>
+    [[nodiscard]] bool __fits(std::uint64_t offset, std::uint64_t count, std::uint64_t next) const {
+        return offset % 8 == 0 && offset <= next && count <= (next - offset) / sizeof(T);
+    }
+
+    [[nodiscard]] bool __valid() const {
+        if ( !_data ) return false;
+        auto& h = header();
+        if ( std::memcmp(h.Magic, "YDFA", 4) || h.Version != Version || h.Size != _size ) return false;
+        if ( h.States == 0 || h.ClassCount == 0 || h.Terminals > h.States || h.Scopes > 64 || h.Starts == 0 ) return false;
+        if ( h.Transitions < sizeof(Header) || !__fits<std::uint32_t>(h.Transitions, (std::uint64_t)h.States * h.ClassCount, h.Accepting)
+            || !__fits<std::uint32_t>(h.Accepting, h.States, h.TokenInfo) || !__fits<TokenInfo>(h.TokenInfo, h.Tokens, h.ScopeNames)
+            || !__fits<String>(h.ScopeNames, h.Scopes, h.StartStates) || !__fits<Start>(h.StartStates, h.Starts, h.After)
+            || !__fits<std::uint32_t>(h.After, (std::uint64_t)h.Starts * h.Tokens, h.Strings) || h.Strings > h.Size ) return false;
+
+        auto strings = h.Size - h.Strings;
+        auto fits = [&](const String& s) { return s.Offset <= strings && s.Length <= strings - s.Offset; };
+        for ( std::uint64_t i = 0; i < (std::uint64_t)h.States * h.ClassCount; i++ ) {
+            if ( __section<std::uint32_t>(h.Transitions)[i] >= h.States ) return false;
+        }
+        for ( std::uint32_t c = 0; c < 256; c++ ) {
+            if ( h.Classes[c] >= h.ClassCount ) return false;
+        }
+        for ( std::uint32_t s = 0; s < h.States; s++ ) {
+            if ( accepting(s) > h.Tokens ) return false;
+        }
+        for ( std::uint32_t t = 0; t < h.Tokens; t++ ) {
+            if ( !fits(token(t).Name) || !fits(token(t).ErrorMsg) ) return false;
+        }
+        for ( std::uint32_t s = 0; s < h.Scopes; s++ ) {
+            if ( !fits(__section<String>(h.ScopeNames)[s]) ) return false;
+        }
+        for ( std::uint32_t s = 0; s < h.Starts; s++ ) {
+            if ( scopeSet(s).State >= h.States ) return false;
+        }
+        for ( std::uint64_t i = 0; i < (std::uint64_t)h.Starts * h.Tokens; i++ ) {
+            if ( __section<std::uint32_t>(h.After)[i] >= h.Starts ) return false;
+        }
+        return true;
+    }
+
+    void* _data = nullptr;
+    std::size_t _size;
+};
+
+// plain record of a lexed token, the lexeme itself stays in the input
+struct Token {
+    // index of the token in the spec, its name is Tables::name(Id)
+    std::uint32_t Id;
+    std::size_t Offset, Length;
+    // line (from 1) and column (from 0) of the first byte
+    std::size_t Line, Col;
+
+    [[nodiscard]] std::string_view lexeme(std::string_view input) const { return input.substr(Offset, Length); }
+};
+
+class LexError final : public std::exception {
+public:
+    LexError(std::string_view message, std::size_t line, std::size_t col) :
+        _what("Invalid token at (L:" + std::to_string(line) + ", C:" + std::to_string(col) + "): " + std::string(message)) {}
+    [[nodiscard]] const char* what() const noexcept override { return _what.c_str(); }
+private:
+    std::string _what;
+};
+
+// lexes input on demand, one token per call to next(), like the generated lexers do
+// both the tables and the input have to outlive the lexer
+class Lexer final {
+public:
+    Lexer(const Tables& tables, std::string_view input) : _tables(tables), _input(input), _pos(0), _set(0), _line(1), _col(0) {}
+
+    // the next token that isn't skipped, nothing at the end of the input
+    [[nodiscard]] std::optional<Token> next() {
+        while ( _pos < _input.size() ) {
+            auto token = __read();
+            if ( token ) return token;
+        }
+        return std::nullopt;
+    }
+private:
+    // lexes the longest token at the current position, nothing if it is skipped
+    [[nodiscard]] std::optional<Token> __read() {
+        auto terminals = _tables.header().Terminals;
+        std::uint32_t state = _tables.scopeSet(_set).State, accepted = 0;
+        std::size_t pos = _pos, accept = _pos;
+        while ( pos < _input.size() ) {
+            state = _tables.next(state, _input[pos]);
+            if ( state == 0 ) break;
+            pos++;
+            if ( auto a = _tables.accepting(state) ) {
+                accepted = a;
+                accept = pos;
+                // nothing longer can match
+                if ( state >= terminals ) break;
+            }
+        }
+
+        if ( accepted == 0 ) {
+            auto end = std::min(pos + 1, _input.size());
+            throw LexError(_input.substr(_pos, end - _pos), _line, _col);
+        }
+        auto& info = _tables.token(accepted - 1);
+        if ( info.Flags & 2 ) throw LexError(_tables.string(info.ErrorMsg), _line, _col);
+
+        Token token = { accepted - 1, _pos, accept - _pos, _line, _col };
+        for ( ; _pos < accept; _pos++ ) {
+            if ( _input[_pos] == '\n' ) {
+                _line++;
+                _col = 0;
+            } else {
+                _col++;
+            }
+        }
+        _set = _tables.after(_set, accepted - 1);
+        if ( info.Flags & 1 ) return std::nullopt;
+        return token;
+    }
+
+    const Tables& _tables;
+    std::string_view _input;
+    std::size_t _pos;
+    // number of the scope set the lexer is in
+    std::uint32_t _set;
+    // line and column of input[_pos]
+    std::size_t _line, _col;
+};
+
+}
+
+#endif
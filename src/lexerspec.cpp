@@ -0,0 +1,144 @@
+#include "lexerspec.h"
+#include "framework/dbg.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <thread>
+
+namespace yunolex {
+
+LexerSpec::LexerSpec(std::vector<Token*>* tokens, unsigned jobs) : _tokens(*tokens) {
+    __buildScopes(jobs);
+    __buildClasses();
+}
+
+LexerSpec::~LexerSpec() {
+    interfaces::apply<Automata*>(_automata, [](Automata* a) -> void { delete a; });
+    interfaces::apply<Token*>(_tokens, [](Token* t) -> void { delete t; });
+}
+
+void LexerSpec::__buildScopes(unsigned jobs) {
+    // combinations of active tokens that get an automaton, in the order they were found
+    std::map<std::vector<std::size_t>, std::size_t> combined;
+    std::vector<std::vector<std::size_t>> combinations;
+    std::deque<std::set<std::string>> work;
+    work.push_back({ OUTERSCOPE });
+
+    while ( !work.empty() ) {
+        auto scope = work.front();
+        work.pop_front();
+        if ( _scopes.contains(scope) ) continue;
+
+        std::vector<std::size_t> active;
+        for ( std::size_t i = 0; i < _tokens.size(); i++ ) {
+            auto in = _tokens[i]->In;
+            if ( std::any_of(in.begin(), in.end(), [&scope](const std::string& s) { return scope.contains(s); }) ) {
+                active.push_back(i);
+
+                // same order the lexer applies them in: enter first, then leave
+                auto next = scope;
+                next.insert(_tokens[i]->Enter.begin(), _tokens[i]->Enter.end());
+                for ( auto l : _tokens[i]->Leave ) next.erase(l);
+                if ( !_scopes.contains(next) ) work.push_back(next);
+            }
+        }
+
+        if ( !combined.contains(active) ) {
+            combined.insert({ active, combinations.size() });
+            combinations.push_back(active);
+        }
+        _scopes.insert({ scope, combined.at(active) });
+    }
+
+    // the automata don't depend on each other, so they can be built on several threads,
+    // each taking the next unbuilt one until none are left
+    auto parallel = [jobs](std::size_t count, const std::function<void(std::size_t)>& work) {
+        std::atomic<std::size_t> next = 0;
+        auto build = [&]() {
+            for ( auto i = next++; i < count; i = next++ ) work(i);
+        };
+        std::vector<std::thread> workers;
+        for ( unsigned j = 1; j < std::min<std::size_t>(jobs, count); j++ ) workers.emplace_back(build);
+        build();
+        for ( auto& w : workers ) w.join();
+    };
+
+    // every token is determinized and minimized on its own first, so even a spec with a single scope set
+    // spreads most of the work over the threads, and combining only determinizes a union of small DFAs
+    std::vector<Automata*> singles(_tokens.size(), nullptr);
+    std::vector<std::size_t> used;
+    for ( std::size_t i = 0; i < _tokens.size(); i++ ) {
+        if ( std::any_of(combinations.begin(), combinations.end(), [i](auto& c) { return std::binary_search(c.begin(), c.end(), i); }) ) {
+            used.push_back(i);
+        }
+    }
+    parallel(used.size(), [&](std::size_t u) { singles[used[u]] = __single(used[u]); });
+
+    _automata.resize(combinations.size());
+    _reports.resize(combinations.size());
+    parallel(combinations.size(), [&](std::size_t c) { _automata[c] = __combine(singles, combinations[c], _reports[c]); });
+    for ( auto a : singles ) delete a;
+
+    info(std::cout, "Combined automata for " + std::to_string(_scopes.size()) + " scope sets into "
+        + std::to_string(_automata.size()) + " automata.");
+}
+
+Automata* LexerSpec::__single(std::size_t token) const {
+    auto automaton = _tokens[token]->Regex->automata();
+    automaton->label(token);
+    automaton->DFAify();
+    automaton->minimize();
+    return automaton;
+}
+
+Automata* LexerSpec::__combine(const std::vector<Automata*>& singles, const std::vector<std::size_t>& active, MinimizeReport& report) {
+    // copies, since uniting consumes them and other combinations may share a token
+    std::vector<Automata*> parts;
+    for ( auto i : active ) parts.push_back(new Automata(*singles[i]));
+    auto automaton = Automata::unite(parts);
+    automaton->DFAify();
+    report = automaton->minimize();
+    return automaton;
+}
+
+unsigned char LexerSpec::symbolByte(const std::string& symbol) {
+    // regexes keep escapes in their source form
+    if ( symbol.size() > 1 && symbol[0] == '\\' ) {
+        switch ( symbol[1] ) {
+            case 'n': return '\n';
+            case 't': return '\t';
+            case 'f': return '\f';
+            case 'r': return '\r';
+            case 'x': return (unsigned char)std::stoi(symbol.substr(2), nullptr, 16);
+        }
+    }
+    return (unsigned char)symbol[0];
+}
+
+void LexerSpec::__buildClasses() {
+    // refine a single class with every state's transitions, two bytes stay in the same class
+    // only if every state in every automaton sends them to the same place
+    _classes.fill(0);
+    _classCount = 1;
+    for ( auto a : _automata ) {
+        for ( auto& s : a->states() ) {
+            if ( s.Outbound.empty() ) continue;
+            std::array<std::size_t, 256> dest;
+            dest.fill(NOTOKEN);
+            for ( auto& t : s.Outbound ) dest[symbolByte(t.Symbol)] = t.Dest;
+
+            std::map<std::pair<std::size_t, std::size_t>, unsigned char> split;
+            for ( std::size_t b = 0; b < 256; b++ ) {
+                auto key = std::make_pair((std::size_t)_classes[b], dest[b]);
+                if ( !split.contains(key) ) split.insert({ key, (unsigned char)split.size() });
+                _classes[b] = split.at(key);
+            }
+            _classCount = split.size();
+        }
+    }
+    info(std::cout, "Compressed the alphabet into " + std::to_string(_classCount) + " byte classes.");
+}
+
+}
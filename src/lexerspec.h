@@ -0,0 +1,61 @@
+#ifndef YUNOLEX_LEXERSPEC_H
+#define YUNOLEX_LEXERSPEC_H
+
+#include <array>
+#include <map>
+#include <vector>
+
+#include "automata/automata.h"
+#include "parser/parse.h"
+
+namespace yunolex {
+
+/**
+ * Everything a printer needs to emit a lexer
+ * Tokens keep their order from the spec, which is also their priority (earlier wins ties).
+ * Rather than running one automaton per token, every reachable combination of scopes
+ * gets a single DFA over the tokens active in it.
+ */
+class LexerSpec final {
+public:
+    // jobs is the number of threads building automata, which doesn't change the result
+    explicit LexerSpec(std::vector<Token*>* tokens, unsigned jobs = 1);
+    ~LexerSpec();
+
+    [[nodiscard]] const std::vector<Token*>& tokens() const { return _tokens; }
+
+    // combined automata, one per distinct set of active tokens
+    [[nodiscard]] const std::vector<Automata*>& automata() const { return _automata; }
+
+    // every scope set the lexer can be in, mapped to the index of its automaton
+    [[nodiscard]] const std::map<std::set<std::string>, std::size_t>& scopes() const { return _scopes; }
+
+    // minimization results, parallel to automata()
+    [[nodiscard]] const std::vector<MinimizeReport>& reports() const { return _reports; }
+
+    // equivalence classes of input bytes, bytes in the same class are never told apart by any automaton
+    [[nodiscard]] const std::array<unsigned char, 256>& classes() const { return _classes; }
+    [[nodiscard]] std::size_t classCount() const { return _classCount; }
+    [[nodiscard]] std::size_t symbolClass(const std::string& symbol) const { return _classes[symbolByte(symbol)]; }
+
+    // the byte a transition symbol stands for
+    [[nodiscard]] static unsigned char symbolByte(const std::string&);
+private:
+    void __buildScopes(unsigned jobs);
+    // builds the minimal DFA of a single token
+    [[nodiscard]] Automata* __single(std::size_t token) const;
+    // builds the DFA over the given tokens from their own DFAs
+    [[nodiscard]] static Automata* __combine(const std::vector<Automata*>& singles, const std::vector<std::size_t>& active, MinimizeReport& report);
+    void __buildClasses();
+
+    std::vector<Token*> _tokens;
+    std::vector<Automata*> _automata;
+    std::map<std::set<std::string>, std::size_t> _scopes;
+    std::vector<MinimizeReport> _reports;
+    std::array<unsigned char, 256> _classes;
+    std::size_t _classCount;
+};
+
+}
+
+#endif
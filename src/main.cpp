@@ -6,10 +6,17 @@
 #include "printer.h"
 
 void printUsage() {
-    std::cout << "usage: yunolex [-h] [-o FILE] [-l LANG] INPUT" << std::endl;
+    std::cout << "usage: yunolex [-h] [-s] [-g] [-b] [-r MODE] [-j N] [-o FILE] [-l LANG] INPUT" << std::endl;
     std::cout << "  -h, --help  show this help menu and exit" << std::endl;
     std::cout << "  -o FILE     name output file as FILE" << std::endl;
     std::cout << "  -d DIR      output automata as dot files to DIR" << std::endl;
+    std::cout << "  -s          print automata sizes and minimization times" << std::endl;
+    std::cout << "  -g          emit direct-coded automata (switch/goto) instead of tables" << std::endl;
+    std::cout << "  -b          write binary tables for lexers/ydfa.h instead of a lexer (default FILE lexer.ydfa)," << std::endl;
+    std::cout << "              which always throws on errors, so not together with -g or -r" << std::endl;
+    std::cout << "  -r MODE     on errors, lex an error token and go on from the next byte (byte)" << std::endl;
+    std::cout << "              or from the next byte a token can start with (resync), instead of throwing" << std::endl;
+    std::cout << "  -j N        determinize tokens and scope sets on N threads" << std::endl;
     //std::cout << "  -l LANG     change output language to LANG (supports CPP)" << std::endl;
 }
 
@@ -20,8 +27,13 @@ int main(int argc, char** argv) {
     }
 
     std::string input = "";
-    std::string output = "lexer.h";
+    std::string output = "";
     std::string dotdir = "";
+    bool stats = false;
+    bool direct = false;
+    auto lang = yunolex::Language::CPP;
+    auto recovery = yunolex::Recovery::Throw;
+    unsigned jobs = 1;
 
     // parse arguments
     for ( int i = 1; i < argc; i++ ) {
@@ -42,12 +54,38 @@ int main(int argc, char** argv) {
                 return 1;
             }
             dotdir = std::string(argv[i]);
+        } else if ( !strcmp(argv[i], "-s") ) {
+            stats = true;
+        } else if ( !strcmp(argv[i], "-g") ) {
+            direct = true;
+        } else if ( !strcmp(argv[i], "-b") ) {
+            lang = yunolex::Language::YDFA;
+        } else if ( !strcmp(argv[i], "-r") ) {
+            i++;
+            if ( i == argc || (strcmp(argv[i], "byte") && strcmp(argv[i], "resync")) ) {
+                printUsage();
+                return 1;
+            }
+            recovery = !strcmp(argv[i], "byte") ? yunolex::Recovery::SkipByte : yunolex::Recovery::Resync;
+        } else if ( !strcmp(argv[i], "-j") ) {
+            i++;
+            if ( i == argc || atoi(argv[i]) < 1 ) {
+                printUsage();
+                return 1;
+            }
+            jobs = atoi(argv[i]);
         } else if ( input == "" ) {
             input = argv[i];
         }
     }
+    // binary tables are lexed by lexers/ydfa.h, which has neither direct code nor error recovery
+    if ( lang == yunolex::Language::YDFA && (direct || recovery != yunolex::Recovery::Throw) ) {
+        std::cerr << "-b can't be combined with " << (direct ? "-g" : "-r") << std::endl;
+        return 1;
+    }
+    if ( output == "" ) output = lang == yunolex::Language::YDFA ? "lexer.ydfa" : "lexer.h";
     yunolex::info(std::cout, "Finished parsing arguments");
-    yunolex::info(std::cout, "Language: CPP");
+    yunolex::info(std::cout, lang == yunolex::Language::YDFA ? "Language: YDFA" : "Language: CPP");
     yunolex::info(std::cout, "Output file: " + output);
 
     // Parse input file
@@ -62,32 +100,29 @@ int main(int argc, char** argv) {
     }
     yunolex::info(std::cout, "Finished parsing input file.\n");
 
-    // create DFAs from regexes
-    // automataInfo maps scopes to tokenname/automata pairs
-    std::map<yunolex::Token*, yunolex::Automata*> automataInfo;
-
-    for ( auto token : *tokeninfo ) {
-        auto automaton = token->Regex->automata();
-        automaton->DFAify();
-        automaton->minimize();
-        automataInfo.insert({token, automaton});
-    }
+    // create DFAs from regexes, combining the tokens of each scope set into one automaton
+    auto spec = new yunolex::LexerSpec(tokeninfo, jobs);
     delete tokeninfo;
     yunolex::info(std::cout, "Finished creating automata.\n");
 
+    if ( stats ) {
+        for ( std::size_t i = 0; i < spec->reports().size(); i++ ) {
+            auto report = spec->reports()[i];
+            std::cout << "automaton " << i << ": " << report.Before << " -> " << report.After << " states, minimized in "
+                << std::chrono::duration<double, std::milli>(report.Time).count() << "ms" << std::endl;
+        }
+    }
+
     // Creating lexer file for appropriate language and serializing automata
     try {
-        auto p = yunolex::Printer::instance(yunolex::Language::CPP, output);
-        p->outputAutomata(&automataInfo);
+        auto p = yunolex::Printer::instance(lang, output, direct, recovery);
+        p->outputAutomata(spec);
         delete p;
     } catch (yunolex::PrinterException& p) {
         std::cerr << p.what() << std::endl;
         return 1;
     }
-    for ( auto v : automataInfo ) {
-        delete v.first;
-        delete v.second;
-    }
+    delete spec;
     yunolex::info(std::cout, "Finished creating lexer file.");
 
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "framework/dbg.h"
 #include "parser/parse.h"
 
+#include <algorithm>
+#include <cctype>
 #include <filesystem>
 
 namespace yunolex {
@@ -22,72 +24,413 @@ Printer::Printer(std::string input, std::string output) {
         throw PrinterException("Could not open specified output file: " + output);
     }
 
+    // copy the template up to the line where the tables go, and hold on to the rest
     std::string c;
+    bool tables = false;
     while ( std::getline(infile, c) ) {
-        _outfile << c << std::endl;
+        if ( tables ) {
+            _tail += c + "\n";
+        } else if ( c.find("%TABLES%") != std::string::npos ) {
+            tables = true;
+        } else {
+            _outfile << c << std::endl;
+        }
     }
 
     infile.close();
 }
 
-Printer* Printer::instance(Language lang, std::string output) {
-    if ( lang == Language::CPP ) return new CppPrinter(output);
+Printer::Printer(std::string output) {
+    _outfile.open(output, std::ios::binary);
+
+    if ( !_outfile ) {
+        throw PrinterException("Could not open specified output file: " + output);
+    }
+}
+
+Printer* Printer::instance(Language lang, std::string output, bool direct, Recovery recovery) {
+    if ( lang == Language::CPP && direct ) return new CppDirectPrinter(output, recovery);
+    if ( lang == Language::CPP ) return new CppPrinter(output, recovery);
+    if ( lang == Language::YDFA ) return new BinaryPrinter(output);
     throw PrinterException("Somehow you chose a language that doesn't exist");
 }
 
-void CppPrinter::outputAutomata(std::map<Token*, Automata*>* automata) {
-    for ( auto a : *automata ) {
-        _outfile << "\t\tnew Automaton(" << std::endl;
-        // token name
-        _outfile << "\t\t\t\"" << a.first->Name << "\"," << std::endl;
-        // start state
-        _outfile << "\t\t\t\"" << a.second->startState()->toString() << "\"," << std::endl;
-        // transition table
-        _outfile << "\t\t\t{";
-        bool b = false;
-        for ( auto s : *a.second->states() ) {
-            if ( s->outbound().empty() ) continue;
-            if ( b ) _outfile << " ";
-            _outfile << "{\"" << s->toString() << "\",{";
-            for ( auto t : s->outbound() ) {
-                _outfile << "{\'";
-                if ( t->symbol() == "\'" || t->symbol() == "\"" || t->symbol() == "\\" ) {
-                    _outfile << "\\";
-                }
-                _outfile << t->symbol() << "\',\"" << t->dest()->toString() << "\"},";
+void Printer::numberStates(LexerSpec* spec) {
+    // states of all automata share one numbering, starting from 1 since 0 is the dead state
+    // states with a skippable self loop come first and terminal states last,
+    // so the lexer can tell them apart by their number alone
+    auto& automata = spec->automata();
+    _ids.assign(automata.size(), {});
+    _order.assign(1, { 0, 0 });
+    _loops.assign(1, {});
+    for ( int rank = 0; rank < 3; rank++ ) {
+        if ( rank == 1 ) _loopCount = _order.size();
+        if ( rank == 2 ) _terminals = _order.size();
+        for ( std::size_t a = 0; a < automata.size(); a++ ) {
+            _ids[a].resize(automata[a]->states().size());
+            for ( std::size_t i = 0; i < automata[a]->states().size(); i++ ) {
+                auto loop = loopBytes(spec, a, i);
+                if ( (automata[a]->terminal(i) ? 2 : loop.Ranges.empty() ? 1 : 0) != rank ) continue;
+                _ids[a][i] = _order.size();
+                _order.push_back({ a, i });
+                if ( rank == 0 ) _loops.push_back(loop);
+            }
+        }
+    }
+}
+
+void Printer::numberScopes(LexerSpec* spec) {
+    // every scope gets a bit, the outer scope the lowest
+    _scopeBits.clear();
+    _scopeBits[OUTERSCOPE] = 0;
+    _scopeNames = { OUTERSCOPE };
+    for ( auto t : spec->tokens() ) {
+        for ( auto& set : { t->In, t->Enter, t->Leave } ) {
+            for ( auto& scope : set ) {
+                if ( _scopeBits.count(scope) ) continue;
+                _scopeBits[scope] = _scopeNames.size();
+                _scopeNames.push_back(scope);
+            }
+        }
+    }
+    if ( _scopeNames.size() > MAXSCOPES ) throw PrinterException("Too many scopes, at most " + std::to_string(MAXSCOPES) + " are supported");
+}
+
+void Printer::numberScopeSets(LexerSpec* spec) {
+    // every reachable scope set gets a number, the outer scope 0,
+    // and the scope set lexing each token leads to, so scopes cost a lexer two lookups per token
+    _scopeSets.clear();
+    for ( auto& s : spec->scopes() ) _scopeSets.push_back(s.first);
+    std::stable_partition(_scopeSets.begin(), _scopeSets.end(), [](const std::set<std::string>& s) { return s == std::set<std::string>{ OUTERSCOPE }; });
+    std::map<std::set<std::string>, std::size_t> numbers;
+    for ( std::size_t i = 0; i < _scopeSets.size(); i++ ) numbers[_scopeSets[i]] = i;
+
+    _after.clear();
+    for ( auto& s : _scopeSets ) {
+        for ( auto t : spec->tokens() ) {
+            // tokens that can't be lexed in the set leave it as it is
+            auto next = s;
+            if ( std::any_of(t->In.begin(), t->In.end(), [&s](const std::string& in) { return s.contains(in); }) ) {
+                next.insert(t->Enter.begin(), t->Enter.end());
+                for ( auto& l : t->Leave ) next.erase(l);
+            }
+            _after.push_back(numbers.at(next));
+        }
+    }
+}
+
+std::size_t Printer::startState(LexerSpec* spec, std::size_t set) const {
+    auto a = spec->scopes().at(_scopeSets[set]);
+    return _ids[a][spec->automata()[a]->startState()];
+}
+
+void CppPrinter::printTables(LexerSpec* spec) {
+    numberStates(spec);
+
+    _outfile << "using State = " << integerType(_order.size() - 1) << ";" << std::endl;
+    _outfile << "using TokenId = " << integerType(spec->tokens().size()) << ";" << std::endl;
+    _outfile << "inline constexpr std::size_t States = " << _order.size() << ";" << std::endl;
+    _outfile << "inline constexpr std::size_t Terminals = " << _terminals << ";" << std::endl;
+
+    // bytes that loop back to each of the first states
+    _outfile << "inline constexpr std::size_t Loops = " << _loopCount << ";" << std::endl;
+    _outfile << "inline constexpr Loop loops[Loops] = {" << std::endl;
+    for ( auto& l : _loops ) {
+        _outfile << "\t{ " << l.Ranges.size() << ", {";
+        for ( auto& r : l.Ranges ) _outfile << (int)r.first << ",";
+        _outfile << "}, {";
+        for ( auto& r : l.Ranges ) _outfile << (int)r.second << ",";
+        _outfile << "}, " << l.Stops.size() << ", {";
+        for ( auto b : l.Stops ) _outfile << (int)b << ",";
+        _outfile << "}, " << skipFunction(l) << " }," << std::endl;
+    }
+    _outfile << "};" << std::endl;
+
+    numberScopes(spec);
+    _outfile << "inline constexpr std::string_view scopes[] = {";
+    for ( auto& n : _scopeNames ) _outfile << " \"" << n << "\",";
+    _outfile << " };" << std::endl;
+
+    // token ids, in order of priority
+    std::set<std::string> used;
+    _outfile << "enum class TokenKind : TokenId {" << std::endl;
+    for ( auto t : spec->tokens() ) _outfile << "\t" << identifier(t->Name, used) << "," << std::endl;
+    _outfile << "};" << std::endl;
+
+    // token info, in order of priority
+    _outfile << "inline constexpr TokenInfo tokens[] = {" << std::endl;
+    for ( auto t : spec->tokens() ) {
+        _outfile << "\t{ \"" << t->Name << "\", ";
+        printScopeSet(t->In);
+        _outfile << ", ";
+        printScopeSet(t->Enter);
+        _outfile << ", ";
+        printScopeSet(t->Leave);
+        _outfile << ", " << (t->Skip ? "true, " : "false, ") 
+            << (t->Error ? "true, \"" + t->ErrorMsg + "\"" : "false, \"\"") << " }," << std::endl;
+    }
+    _outfile << "};" << std::endl;
+    _outfile << "inline constexpr Recovery recovery = Recovery::"
+        << (_recovery == Recovery::Resync ? "Resync" : _recovery == Recovery::SkipByte ? "SkipByte" : "Throw") << ";" << std::endl;
+
+    // every reachable scope set with the start state of its automaton, and the scope set lexing each token leads to
+    numberScopeSets(spec);
+    _outfile << "using ScopeSetId = " << integerType(_scopeSets.size() - 1) << ";" << std::endl;
+    _outfile << "inline constexpr std::size_t ScopeSets = " << _scopeSets.size() << ";" << std::endl;
+    _outfile << "inline constexpr std::size_t Tokens = " << spec->tokens().size() << ";" << std::endl;
+    _outfile << "inline constexpr ScopeSet scopeSets[ScopeSets] = {" << std::endl << "\t";
+    for ( auto& s : _scopeSets ) _outfile << "0x" << std::hex << scopeSet(s) << std::dec << ",";
+    _outfile << std::endl << "};" << std::endl;
+    _outfile << "inline constexpr State starts[ScopeSets] = {" << std::endl << "\t";
+    for ( std::size_t s = 0; s < _scopeSets.size(); s++ ) _outfile << startState(spec, s) << ",";
+    _outfile << std::endl << "};" << std::endl;
+    _outfile << "inline constexpr ScopeSetId after[ScopeSets * Tokens] = {" << std::endl;
+    for ( std::size_t s = 0; s < _scopeSets.size(); s++ ) {
+        _outfile << "\t";
+        for ( std::size_t t = 0; t < spec->tokens().size(); t++ ) _outfile << _after[s * spec->tokens().size() + t] << ",";
+        _outfile << std::endl;
+    }
+    _outfile << "};" << std::endl;
+
+    printAutomata(spec);
+}
+
+void CppPrinter::printAutomata(LexerSpec* spec) {
+    _outfile << "inline constexpr std::size_t Classes = " << spec->classCount() << ";" << std::endl;
+
+    // byte classes
+    _outfile << "inline constexpr unsigned char classes[256] = {";
+    for ( std::size_t b = 0; b < 256; b++ ) {
+        if ( b % 32 == 0 ) _outfile << std::endl << "\t";
+        _outfile << (int)spec->classes()[b] << ",";
+    }
+    _outfile << std::endl << "};" << std::endl;
+
+    // transition table, one row of classes per state
+    _outfile << "inline constexpr State transitions[States * Classes] = {" << std::endl << "\t";
+    for ( std::size_t c = 0; c < spec->classCount(); c++ ) _outfile << "0,";
+    _outfile << std::endl;
+    for ( std::size_t id = 1; id < _order.size(); id++ ) {
+        auto [a, i] = _order[id];
+        std::vector<std::size_t> row(spec->classCount(), 0);
+        for ( auto& t : spec->automata()[a]->state(i).Outbound ) row[spec->symbolClass(t.Symbol)] = _ids[a][t.Dest];
+        _outfile << "\t";
+        for ( auto d : row ) _outfile << d << ",";
+        _outfile << std::endl;
+    }
+    _outfile << "};" << std::endl;
+
+    // accepted token of every state
+    _outfile << "inline constexpr TokenId accepting[States] = {" << std::endl << "\t0,";
+    for ( std::size_t id = 1; id < _order.size(); id++ ) {
+        auto& s = spec->automata()[_order[id].first]->state(_order[id].second);
+        _outfile << (s.Final ? s.Token + 1 : 0) << ",";
+    }
+    _outfile << std::endl << "};" << std::endl;
+}
+
+void CppDirectPrinter::printAutomata(LexerSpec* spec) {
+    _outfile << "#define YUNOLEX_DIRECT" << std::endl << std::endl;
+    _outfile << "inline std::size_t scan(Scan& scan, const unsigned char* input, std::size_t pos, std::size_t end) {" << std::endl;
+
+    // resume from wherever the last run stopped
+    _outfile << "\tswitch ( scan.Current ) {" << std::endl;
+    // nothing can follow terminal states
+    for ( std::size_t s = 1; s < _terminals; s++ ) _outfile << "\t\tcase " << s << ": goto s" << s << ";" << std::endl;
+    _outfile << "\t\tdefault:" << std::endl << "\t\t\tscan.Current = 0;" << std::endl << "\t\t\treturn pos;" << std::endl << "\t}" << std::endl;
+
+    // every state is a block that switches on the next byte and jumps straight to the next block
+    // accepting states are entered through an extra label that records the match
+    // terminal states end the run right there, since nothing longer can match
+    for ( std::size_t id = 1; id < _order.size(); id++ ) {
+        auto [a, i] = _order[id];
+        auto& states = spec->automata()[a]->states();
+        if ( states[i].Final ) {
+            _outfile << "a" << id << ":" << std::endl;
+            _outfile << "\tscan.Token = " << states[i].Token + 1 << ";" << std::endl;
+            _outfile << "\tscan.Accept = pos;" << std::endl;
+        }
+        if ( id >= _terminals ) {
+            _outfile << "\tscan.Current = 0;" << std::endl << "\treturn pos;" << std::endl;
+            continue;
+        }
+        _outfile << "s" << id << ":" << std::endl;
+        if ( id < _loopCount ) {
+            // runs can start or resume in this state, so skipping has to record the match itself
+            auto skip = skipFunction(_loops[id]) + "(loops[" + std::to_string(id) + "], input, pos, end)";
+            if ( states[i].Final ) {
+                _outfile << "\tif ( auto skipped = " << skip << "; skipped != pos ) {" << std::endl;
+                _outfile << "\t\tpos = skipped;" << std::endl;
+                _outfile << "\t\tscan.Token = " << states[i].Token + 1 << ";" << std::endl;
+                _outfile << "\t\tscan.Accept = pos;" << std::endl << "\t}" << std::endl;
+            } else {
+                _outfile << "\tpos = " << skip << ";" << std::endl;
             }
-            _outfile << "}}," << std::endl << "\t\t\t";
-            b = true;
         }
-        _outfile << "}," << std::endl;
-        // final states
-        _outfile << "\t\t\t{";
-        for ( auto f : a.second->finstates() ) {
-            _outfile << "\"" << f->toString() << "\",";
+        _outfile << "\tif ( pos == end ) {" << std::endl;
+        _outfile << "\t\tscan.Current = " << id << ";" << std::endl << "\t\treturn pos;" << std::endl << "\t}" << std::endl;
+
+        std::map<std::size_t, std::vector<unsigned char>> cases;
+        for ( auto& t : states[i].Outbound ) cases[t.Dest].push_back(LexerSpec::symbolByte(t.Symbol));
+        _outfile << "\tswitch ( input[pos] ) {" << std::endl;
+        for ( auto& c : cases ) {
+            _outfile << "\t\t";
+            for ( auto b : c.second ) _outfile << "case " << (int)b << ": ";
+            _outfile << "pos++; goto " << (states[c.first].Final ? "a" : "s") << _ids[a][c.first] << ";" << std::endl;
+        }
+        _outfile << "\t\tdefault:" << std::endl << "\t\t\tscan.Current = 0;" << std::endl << "\t\t\treturn pos;" << std::endl;
+        _outfile << "\t}" << std::endl;
+    }
+    _outfile << "}" << std::endl;
+}
+
+void BinaryPrinter::printTables(LexerSpec* spec) {
+    numberStates(spec);
+    numberScopes(spec);
+    auto& automata = spec->automata();
+    auto& tokens = spec->tokens();
+
+    // names and error messages all go to the end, sections refer to them by offset and length
+    std::string strings;
+    auto putString = [&](std::string& out, const std::string& s) {
+        put<std::uint32_t>(out, strings.size());
+        put<std::uint32_t>(out, s.size());
+        strings += s;
+    };
+
+    // sections in file order, as described by ydfa::Header
+    std::string transitions;
+    for ( std::size_t c = 0; c < spec->classCount(); c++ ) put<std::uint32_t>(transitions, 0);
+    for ( std::size_t id = 1; id < _order.size(); id++ ) {
+        auto [a, i] = _order[id];
+        std::vector<std::uint32_t> row(spec->classCount(), 0);
+        for ( auto& t : automata[a]->state(i).Outbound ) row[spec->symbolClass(t.Symbol)] = _ids[a][t.Dest];
+        for ( auto d : row ) put(transitions, d);
+    }
+
+    std::string accepting;
+    put<std::uint32_t>(accepting, 0);
+    for ( std::size_t id = 1; id < _order.size(); id++ ) {
+        auto& s = automata[_order[id].first]->state(_order[id].second);
+        put<std::uint32_t>(accepting, s.Final ? s.Token + 1 : 0);
+    }
+
+    std::string tokenInfo;
+    for ( auto t : tokens ) {
+        put(tokenInfo, scopeSet(t->In));
+        put(tokenInfo, scopeSet(t->Enter));
+        put(tokenInfo, scopeSet(t->Leave));
+        putString(tokenInfo, t->Name);
+        putString(tokenInfo, t->Error ? t->ErrorMsg : "");
+        put<std::uint32_t>(tokenInfo, (t->Skip ? 1 : 0) | (t->Error ? 2 : 0));
+        put<std::uint32_t>(tokenInfo, 0);
+    }
+
+    std::string scopes;
+    for ( auto& n : _scopeNames ) putString(scopes, n);
+
+    numberScopeSets(spec);
+    std::string starts;
+    for ( std::size_t s = 0; s < _scopeSets.size(); s++ ) {
+        put(starts, scopeSet(_scopeSets[s]));
+        put<std::uint32_t>(starts, startState(spec, s));
+        put<std::uint32_t>(starts, 0);
+    }
+    std::string after;
+    for ( auto next : _after ) put<std::uint32_t>(after, next);
+
+    // every section starts 8-byte aligned
+    std::vector<std::string*> sections = { &transitions, &accepting, &tokenInfo, &scopes, &starts, &after, &strings };
+    std::vector<std::uint64_t> offsets;
+    std::uint64_t size = 8 * 4 + 8 * 8 + 256;
+    for ( auto section : sections ) {
+        offsets.push_back(size);
+        section->resize((section->size() + 7) / 8 * 8, '\0');
+        size += section->size();
+    }
+    offsets.push_back(size);
+
+    std::string header = "YDFA";
+    put<std::uint32_t>(header, YDFAVERSION);
+    for ( std::size_t count : { _order.size(), spec->classCount(), _terminals, tokens.size(), _scopeNames.size(), _scopeSets.size() } ) {
+        put<std::uint32_t>(header, count);
+    }
+    for ( auto offset : offsets ) put(header, offset);
+    for ( auto c : spec->classes() ) header += (char)c;
+
+    _outfile << header;
+    for ( auto section : sections ) _outfile << *section;
+}
+
+std::string CppPrinter::skipFunction(const LoopBytes& loop) {
+    if ( loop.Ranges.empty() ) return "nullptr";
+    return "skip<" + std::to_string(loop.Ranges.size()) + ", " + std::to_string(loop.Stops.size()) + ">";
+}
+
+LoopBytes Printer::loopBytes(LexerSpec* spec, std::size_t a, std::size_t id) {
+    std::array<bool, 256> loops{};
+    for ( auto& t : spec->automata()[a]->state(id).Outbound ) {
+        if ( t.Dest == id ) loops[LexerSpec::symbolByte(t.Symbol)] = true;
+    }
+
+    // single bytes between two ranges are usually terminators, like the quote after a string body,
+    // and are cheaper to test for on their own than as the ends of two ranges
+    // they can't be searched for with memchr or memmem instead: wildcards and negated classes only cover tab, newline
+    // and printable ascii, so a loop never takes every other byte, and a search would skip bytes that end the token
+    LoopBytes loop;
+    for ( std::size_t b = 0; b < 256; b++ ) {
+        if ( !loops[b] ) {
+            if ( b > 0 && b < 255 && loops[b - 1] && loops[b + 1] && loop.Stops.size() < MAXLOOPSTOPS ) {
+                loop.Stops.push_back(b);
+                loop.Ranges.back().second = b;
+            }
+            continue;
         }
-        _outfile << "}," << std::endl;
-        // in
-        printSet(a.first->In);
-        _outfile << "}," << std::endl;
-        // enter
-        printSet(a.first->Enter);
-        _outfile << "}," << std::endl;
-        // leave
-        printSet(a.first->Leave);
-        _outfile << "}," << std::endl; 
-        _outfile << "\t\t\t" << (a.first->Skip ? "true, " : "false, ") 
-            << (a.first->Error ? "true, \"" + a.first->ErrorMsg + "\"" : "false, \"\"") << std::endl;
-        _outfile << "\t\t)," << std::endl;
-    }
-    _outfile << "\t\t})" << std::endl << "\t) {}" << std::endl << "};"
-        << std::endl << std::endl << "}" << std::endl << std::endl << "#endif" << std::endl;
-}
-
-void CppPrinter::printSet(std::set<std::string>& set) {
-    _outfile << "\t\t\t{";
-    for ( auto i : set ) {
-        _outfile << "\"" << i << "\",";
+        if ( !loop.Ranges.empty() && loop.Ranges.back().second + 1u == b ) loop.Ranges.back().second = b;
+        else loop.Ranges.push_back({ b, b });
     }
+    // every range costs the lexer more work per byte
+    if ( loop.Ranges.size() > MAXLOOPRANGES ) loop = {};
+    return loop;
+}
+
+std::string CppPrinter::identifier(const std::string& name, std::set<std::string>& used) {
+    static const std::set<std::string> keywords = {
+        "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+        "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept", "const", "consteval", "constexpr",
+        "constinit", "const_cast", "continue", "co_await", "co_return", "co_yield", "decltype", "default", "delete",
+        "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float", "for",
+        "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+        "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register", "reinterpret_cast",
+        "requires", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+        "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+        "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+    };
+
+    // token names can be anything, so replace whatever c++ doesn't allow in a name
+    std::string out;
+    for ( auto c : name ) out += std::isalnum((unsigned char)c) ? c : '_';
+    if ( out.empty() || std::isdigit((unsigned char)out[0]) ) out = "_" + out;
+    while ( keywords.count(out) || used.count(out) ) out += "_";
+    used.insert(out);
+    return out;
+}
+
+std::string CppPrinter::integerType(std::size_t max) {
+    if ( max <= UINT8_MAX ) return "std::uint8_t";
+    if ( max <= UINT16_MAX ) return "std::uint16_t";
+    if ( max <= UINT32_MAX ) return "std::uint32_t";
+    return "std::uint64_t";
+}
+
+std::uint64_t Printer::scopeSet(const std::set<std::string>& set) const {
+    std::uint64_t bits = 0;
+    for ( auto& scope : set ) bits |= std::uint64_t(1) << _scopeBits.at(scope);
+    return bits;
+}
+
+void CppPrinter::printScopeSet(const std::set<std::string>& set) {
+    _outfile << "0x" << std::hex << scopeSet(set) << std::dec;
 }
 
 }
\ No newline at end of file
@@ -1,17 +1,40 @@
 #ifndef YUNOLEX_PRINTER_H
 #define YUNOLEX_PRINTER_H
 
+#include <cstdint>
 #include <fstream>
 #include <map>
 
 #include "automata/automata.h"
+#include "lexerspec.h"
 
-namespace yunolex {
+// most byte ranges and stop bytes a self loop can have to be skipped in bulk, as in the templates' Loop struct
+#define MAXLOOPRANGES 4
+#define MAXLOOPSTOPS 4
+// most scopes a spec can name, one per bit of the templates' ScopeSet
+#define MAXSCOPES 64
+// version of the binary table format, as checked by lexers/ydfa.h
+#define YDFAVERSION 2
 
-class Token;
+namespace yunolex {
 
 enum class Language {
-    CPP
+    CPP,
+    // binary tables for the runtime in lexers/ydfa.h, see there for the layout
+    YDFA
+};
+
+// what generated lexers do on errors, as in the templates' Recovery
+enum class Recovery {
+    Throw,
+    SkipByte,
+    Resync
+};
+
+// bytes on which a state loops back to itself: those in Ranges, except for the Stops
+struct LoopBytes {
+    std::vector<std::pair<unsigned char, unsigned char>> Ranges;
+    std::vector<unsigned char> Stops;
 };
 
 class PrinterException : public std::exception {
@@ -29,22 +52,94 @@ public:
         _outfile.close();
     }
 
-    [[nodiscard]] static Printer* instance(Language lang, std::string output);
+    // direct selects direct-coded automata (a goto per transition) over transition tables, where supported
+    // recovery is for languages whose lexers can recover from errors
+    [[nodiscard]] static Printer* instance(Language lang, std::string output, bool direct = false, Recovery recovery = Recovery::Throw);
 
-    virtual void outputAutomata(std::map<Token*, Automata*>*) = 0;
+    // fills the template's %TABLES% line in with the lexer's tables and finishes the file
+    void outputAutomata(LexerSpec* spec) {
+        printTables(spec);
+        _outfile << _tail;
+    }
 protected:
     explicit Printer(std::string input, std::string output);
+    // output without a template, written as is
+    explicit Printer(std::string output);
+
+    virtual void printTables(LexerSpec*) = 0;
+
+    // numbers the states of all automata, the scopes and the reachable scope sets, see _ids, _scopeBits and _scopeSets
+    void numberStates(LexerSpec* spec);
+    void numberScopes(LexerSpec* spec);
+    void numberScopeSets(LexerSpec* spec);
+    // number of the start state of a numbered scope set's automaton
+    [[nodiscard]] std::size_t startState(LexerSpec* spec, std::size_t set) const;
+    // bits of a scope set, as numbered in _scopeBits
+    [[nodiscard]] std::uint64_t scopeSet(const std::set<std::string>& set) const;
+    // bytes on which a state loops back to itself, no ranges if there are too many to skip quickly
+    [[nodiscard]] static LoopBytes loopBytes(LexerSpec* spec, std::size_t a, std::size_t id);
 
     std::ofstream _outfile;
+    // the template after the %TABLES% line
+    std::string _tail;
+
+    // global state number of every automaton's states, and the (automaton, state) behind each number
+    std::vector<std::vector<std::size_t>> _ids;
+    std::vector<std::pair<std::size_t, std::size_t>> _order;
+    // first terminal state's number
+    std::size_t _terminals;
+    // number of states with a skippable self loop (+1 for the dead state), and their loop bytes
+    std::size_t _loopCount;
+    std::vector<LoopBytes> _loops;
+    // bit of every scope in a scope set, and the scope behind each bit
+    std::map<std::string, std::size_t> _scopeBits;
+    std::vector<std::string> _scopeNames;
+    // every reachable scope set, the outer scope first, and the number of the one lexing a token leads to,
+    // indexed by scope set * tokens + token
+    std::vector<std::set<std::string>> _scopeSets;
+    std::vector<std::size_t> _after;
+};
+
+class CppPrinter : public Printer {
+public:
+    explicit CppPrinter(std::string output, Recovery recovery) : Printer("src/lexers/lexcpp.h", output), _recovery(recovery) {}
+
+protected:
+    void printTables(LexerSpec* spec) override;
+    // the automata themselves, as byte class and transition tables
+    virtual void printAutomata(LexerSpec* spec);
+    void printScopeSet(const std::set<std::string>& set);
+    // runtime function that skips a loop's bytes
+    [[nodiscard]] static std::string skipFunction(const LoopBytes& loop);
+    // c++ name for a token that doesn't clash with keywords or the names in used, which it is added to
+    [[nodiscard]] static std::string identifier(const std::string& name, std::set<std::string>& used);
+    // narrowest unsigned integer type that can hold max
+    [[nodiscard]] static std::string integerType(std::size_t max);
+
+    Recovery _recovery;
 };
 
-class CppPrinter final : public Printer {
+// emits the automata as a scan() function with a labelled block per state, like re2c does
+class CppDirectPrinter final : public CppPrinter {
 public:
-    explicit CppPrinter(std::string output) : Printer("src/lexers/lexcpp.h", output) {} 
+    explicit CppDirectPrinter(std::string output, Recovery recovery) : CppPrinter(output, recovery) {}
 
-    void outputAutomata(std::map<Token*, Automata*>* automata) override;
 protected:
-    void printSet(std::set<std::string>& set);
+    void printAutomata(LexerSpec* spec) override;
+};
+
+// writes the tables in the binary format lexers/ydfa.h reads, so lexers can change without recompiling
+class BinaryPrinter final : public Printer {
+public:
+    explicit BinaryPrinter(std::string output) : Printer(output) {}
+
+protected:
+    void printTables(LexerSpec* spec) override;
+    // appends an integer in the machine's byte order
+    template <typename T>
+    void put(std::string& out, T value) {
+        out.append((const char*)&value, sizeof(T));
+    }
 };
 
 }
@@ -0,0 +1,72 @@
+#include "common.h"
+
+#include <cstring>
+#include <random>
+
+// longest match by hand for the spec's a, a*b and skipped \s, which is what both the default lexer
+// and YUNOLEX_LINEAR have to give, no matter how much the default lexer backtracks to get there
+std::vector<Lexer::Token> expected(const std::string& input) {
+    std::vector<Lexer::Token> tokens;
+    std::size_t line = 1, col = 0;
+    for ( std::size_t i = 0; i < input.size(); ) {
+        std::size_t length = 1;
+        auto run = input.find_first_not_of('a', i);
+        bool ab = run != std::string::npos && input[run] == 'b';
+        if ( ab ) length = run - i + 1;
+        if ( !std::strchr(" \t\n\v\f\r", input[i]) ) {
+            Lexer::Token token;
+            token.Id = ab ? Lexer::TokenKind::ab : Lexer::TokenKind::a;
+            token.Offset = i;
+            token.Length = length;
+#ifndef YUNOLEX_NO_POSITIONS
+            token.Line = line;
+            token.Col = col;
+#endif
+            tokens.push_back(token);
+        }
+        for ( auto end = i + length; i < end; i++ ) {
+            if ( input[i] == '\n' ) {
+                line++;
+                col = 0;
+            } else {
+                col++;
+            }
+        }
+    }
+    return tokens;
+}
+
+bool check(const std::string& input) {
+    std::vector<Lexer::Token> tokens;
+    try {
+        tokens = lexed(input);
+    } catch ( Lexer::LexError& e ) {
+        std::cerr << "backtrack: " << e.what() << std::endl;
+        return false;
+    }
+    auto want = expected(input);
+    bool same = tokens.size() == want.size();
+    for ( std::size_t i = 0; same && i < want.size(); i++ ) {
+        same = tokens[i].Id == want[i].Id && tokens[i].Offset == want[i].Offset && tokens[i].Length == want[i].Length;
+#ifndef YUNOLEX_NO_POSITIONS
+        same = same && tokens[i].Line == want[i].Line && tokens[i].Col == want[i].Col;
+#endif
+    }
+    if ( !same ) std::cerr << "backtrack: wrong tokens for an input of " << input.size() << " bytes" << std::endl;
+    return same;
+}
+
+int main() {
+    // long runs of a with and without a b at their end, where the default lexer backtracks over the whole run
+    bool ok = check(std::string(5000, 'a')) && check(std::string(5000, 'a') + "b") && check("a\naab b\n\na");
+    std::mt19937 random(12);
+    for ( int i = 0; ok && i < 300; i++ ) {
+        std::string input;
+        for ( auto pieces = random() % 40; pieces > 0; pieces-- ) {
+            input += std::string(random() % 3 ? random() % 8 : random() % 300, 'a');
+            input += "bb \n"[random() % 4];
+        }
+        ok = check(input);
+    }
+    return ok ? 0 : 1;
+}
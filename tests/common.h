@@ -0,0 +1,47 @@
+#ifndef YUNOLEX_TESTS_COMMON_H
+#define YUNOLEX_TESTS_COMMON_H
+
+#include LEXER
+
+#include <cstdlib>
+#include <iostream>
+#ifdef YDFA
+#include "ydfa.h"
+#endif
+
+// lexes all of input from memory, like Lexer::Lexer::lex
+// built with YDFA naming a table file written by yunolex -b for the same spec,
+// the ydfa runtime has to lex the same tokens, or throw where the generated lexer does
+inline std::vector<Lexer::Token> lexed(std::string_view input) {
+#ifdef YDFA
+    static ydfa::Tables tables(YDFA);
+    std::vector<Lexer::Token> expected;
+    std::vector<ydfa::Token> tokens;
+    bool threw = false, tablesThrew = false;
+    try {
+        expected = Lexer::Lexer::lex(input);
+    } catch ( Lexer::LexError& ) {
+        threw = true;
+    }
+    try {
+        ydfa::Lexer lex(tables, input);
+        while ( auto token = lex.next() ) tokens.push_back(*token);
+    } catch ( ydfa::LexError& ) {
+        tablesThrew = true;
+    }
+    bool same = threw == tablesThrew && (threw || tokens.size() == expected.size());
+    for ( std::size_t i = 0; same && !threw && i < tokens.size(); i++ ) {
+        same = tokens[i].Id == (std::uint32_t)expected[i].Id && tokens[i].Offset == expected[i].Offset && tokens[i].Length == expected[i].Length;
+#ifndef YUNOLEX_NO_POSITIONS
+        same = same && tokens[i].Line == expected[i].Line && tokens[i].Col == expected[i].Col;
+#endif
+    }
+    if ( !same ) {
+        std::cerr << "ydfa: tokens differ from the generated lexer's for an input of " << input.size() << " bytes" << std::endl;
+        std::exit(1);
+    }
+#endif
+    return Lexer::Lexer::lex(input);
+}
+
+#endif
@@ -0,0 +1,67 @@
+#include "common.h"
+
+#include <algorithm>
+#include <random>
+
+// lines (from 1) and columns (from 0) of every offset of input, and of its end, counted byte by byte
+std::vector<std::pair<std::size_t, std::size_t>> counted(std::string_view input) {
+    std::vector<std::pair<std::size_t, std::size_t>> at;
+    std::size_t line = 1, col = 0;
+    for ( char c : input ) {
+        at.emplace_back(line, col);
+        if ( c == '\n' ) {
+            line++;
+            col = 0;
+        } else {
+            col++;
+        }
+    }
+    at.emplace_back(line, col);
+    return at;
+}
+
+// Lines::locate has to find the positions counted by hand, in whatever order tokens are asked for,
+// and so do the positions in the tokens unless they are compiled out
+bool check(const std::string& input, std::mt19937& random) {
+    auto tokens = lexed(input);
+    auto at = counted(input);
+    std::vector<std::size_t> order(tokens.size());
+    for ( std::size_t i = 0; i < order.size(); i++ ) order[i] = i;
+    bool same = true;
+    for ( int pass = 0; pass < 3; pass++ ) {
+        if ( pass == 1 ) std::reverse(order.begin(), order.end());
+        if ( pass == 2 ) std::shuffle(order.begin(), order.end(), random);
+        Lexer::Lines lines(input);
+        for ( auto i : order ) {
+            auto& token = tokens[i];
+            auto position = lines.locate(token);
+            auto [sLine, sCol] = at[token.Offset];
+            auto [eLine, eCol] = at[token.Offset + token.Length];
+            same = same && position.SLine == sLine && position.SCol == sCol && position.ELine == eLine && position.ECol == eCol;
+#ifndef YUNOLEX_NO_POSITIONS
+            same = same && token.Line == sLine && token.Col == sCol;
+#endif
+        }
+    }
+    if ( !same ) std::cerr << "lines: positions differ for an input of " << input.size() << " bytes" << std::endl;
+    return same;
+}
+
+int main() {
+    std::mt19937 random(23);
+    bool ok = check("", random) && check("a", random) && check("\n\nab cd\n", random) && check("x \"one\ntwo\n\" y\n\"\"", random);
+    const std::string pieces[] = { "foo", "bar", " ", "\t", "\n", "\n\n\n", "\"a\nb\"", "\"\n\"", "\"\"" };
+    for ( int i = 0; ok && i < 200; i++ ) {
+        std::string input;
+        auto length = random() % 400;
+        while ( input.size() < length ) {
+            input += pieces[random() % std::size(pieces)];
+            if ( random() % 2 ) input += ' ';
+        }
+        ok = check(input, random);
+    }
+    std::string big;
+    while ( big.size() < 300000 ) big += "lorem \"ipsum\ndolor\" sit\n\tamet\n\n";
+    ok = ok && check(big, random);
+    return ok ? 0 : 1;
+}
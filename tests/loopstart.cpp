@@ -0,0 +1,32 @@
+#include "common.h"
+
+#include <iostream>
+
+// the start state of this spec accepts and loops on 'a', so runs start in a state whose bytes are skipped in bulk
+bool check(const std::vector<Lexer::Token>& tokens, const std::vector<std::size_t>& lengths, const char* what) {
+    bool same = tokens.size() == lengths.size();
+    for ( std::size_t i = 0; same && i < lengths.size(); i++ ) same = tokens[i].Length == lengths[i];
+    if ( !same ) std::cerr << "loopstart: wrong tokens " << what << std::endl;
+    return same;
+}
+
+int main() {
+    bool ok = true;
+    try {
+        ok &= check(lexed("aaa"), { 3 }, "for aaa");
+        ok &= check(lexed(std::string(100, 'a')), { 100 }, "for a run of 100");
+
+        // a run held at the end of a chunk resumes in the loop state
+        Lexer::PushLexer push;
+        std::vector<Lexer::Token> pushed;
+        auto emit = [&](const Lexer::Token& token) { pushed.push_back(token); };
+        push.feed(std::span<const char>("aa", 2), emit);
+        push.feed(std::span<const char>("aaa", 3), emit);
+        push.finish(emit);
+        ok &= check(pushed, { 5 }, "pushed in chunks");
+    } catch ( Lexer::LexError& e ) {
+        std::cerr << "loopstart: " << e.what() << std::endl;
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
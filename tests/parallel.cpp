@@ -0,0 +1,40 @@
+#include "common.h"
+
+#include <iostream>
+#include <random>
+
+bool same(const Lexer::Token& a, const Lexer::Token& b) {
+#ifndef YUNOLEX_NO_POSITIONS
+    if ( a.Line != b.Line || a.Col != b.Col ) return false;
+#endif
+    return a.Id == b.Id && a.Offset == b.Offset && a.Length == b.Length;
+}
+
+// lexing in chunks on several threads has to give the same tokens as lexing all at once,
+// also when chunks start inside a string, where guessing from the outer scope gets every token wrong
+bool check(const std::string& input, unsigned threads) {
+    auto expected = lexed(input);
+    auto tokens = Lexer::Lexer::lex(std::string_view(input), threads);
+    bool ok = tokens.size() == expected.size();
+    for ( std::size_t i = 0; ok && i < expected.size(); i++ ) ok = same(tokens[i], expected[i]);
+    if ( !ok ) std::cerr << "parallel: tokens differ on " << threads << " threads" << std::endl;
+    return ok;
+}
+
+int main() {
+    // words between long strings that hold words too, so a chunk can't tell from its first bytes which it is in
+    std::mt19937 random(7);
+    std::string input;
+    while ( input.size() < (1 << 20) ) {
+        bool quoted = random() % 2;
+        if ( quoted ) input += "\"";
+        for ( auto words = random() % 2000; words > 0; words-- ) {
+            input += std::string(1 + random() % 8, 'a' + random() % 26);
+            input += random() % 10 ? " " : "\n";
+        }
+        if ( quoted ) input += "\" ";
+    }
+    bool ok = true;
+    for ( unsigned threads : { 2, 3, 4, 8 } ) ok &= check(input, threads);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include "common.h"
+
+#include <random>
+
+bool same(const std::vector<Lexer::Token>& a, const std::vector<Lexer::Token>& b) {
+    if ( a.size() != b.size() ) return false;
+    for ( std::size_t i = 0; i < a.size(); i++ ) {
+        if ( a[i].Id != b[i].Id || a[i].Offset != b[i].Offset || a[i].Length != b[i].Length ) return false;
+#ifndef YUNOLEX_NO_POSITIONS
+        if ( a[i].Line != b[i].Line || a[i].Col != b[i].Col ) return false;
+#endif
+    }
+    return true;
+}
+
+// feeding input in chunks cut at the given offsets has to give the same tokens and errors as lexing it whole,
+// with the lexemes of the tokens readable as they are emitted, or throw where lexing it whole throws
+bool check(const std::string& input, const std::vector<std::size_t>& cuts) {
+    std::vector<Lexer::Token> expected;
+    std::vector<Lexer::Diagnostic> diagnostics;
+    bool threw = false;
+    try {
+        expected = lexed(input);
+        Lexer::Lexer whole{ std::string_view(input) };
+        for ( auto& token : whole ) (void)token;
+        diagnostics = whole.diagnostics();
+    } catch ( Lexer::LexError& ) {
+        threw = true;
+    }
+    Lexer::PushLexer push;
+    std::vector<Lexer::Token> tokens;
+    bool lexemes = true, pushThrew = false;
+    auto emit = [&](const Lexer::Token& token) {
+        lexemes = lexemes && push.lexeme(token) == token.lexeme(input);
+        tokens.push_back(token);
+    };
+    try {
+        std::size_t from = 0;
+        for ( auto cut : cuts ) {
+            push.feed(std::span<const char>(input.data() + from, cut - from), emit);
+            from = cut;
+        }
+        push.feed(std::span<const char>(input.data() + from, input.size() - from), emit);
+        push.finish(emit);
+    } catch ( Lexer::LexError& ) {
+        pushThrew = true;
+    }
+    bool ok = threw == pushThrew && (threw || (same(tokens, expected) && lexemes));
+    if ( ok && !threw ) {
+        std::vector<Lexer::Token> errors, pushErrors;
+        for ( auto& d : diagnostics ) errors.push_back(d.Error);
+        for ( auto& d : push.diagnostics() ) pushErrors.push_back(d.Error);
+        ok = same(errors, pushErrors);
+    }
+    if ( !ok ) std::cerr << "push: tokens differ for an input of " << input.size() << " bytes in " << cuts.size() + 1 << " chunks" << std::endl;
+    return ok;
+}
+
+// cuts of 1 to most bytes, some of them empty chunks
+std::vector<std::size_t> cuts(std::size_t size, std::size_t most, std::mt19937& random) {
+    std::vector<std::size_t> cuts;
+    std::size_t at = 0;
+    while ( true ) {
+        at += random() % 8 ? 1 + random() % most : 0;
+        if ( at >= size ) return cuts;
+        cuts.push_back(at);
+    }
+}
+
+int main() {
+    std::mt19937 random(25);
+    const std::string pieces[] = { "a", "aaaa", "b", "ab", "cd", "xyz", " ", "\n", "\"", "\"aa b\"", "\"\"", "1", "22" };
+    bool ok = true;
+    for ( int i = 0; ok && i < 500; i++ ) {
+        std::string input;
+        auto length = random() % 200;
+        while ( input.size() < length ) input += pieces[random() % (std::size(pieces) - (i % 2 ? 0 : 2))];
+        std::vector<std::size_t> bytes;
+        for ( std::size_t at = 1; at < input.size(); at++ ) bytes.push_back(at);
+        ok = check(input, {}) && check(input, bytes) && check(input, cuts(input.size(), 1 + random() % 16, random));
+    }
+    std::string big;
+    while ( big.size() < 300000 ) big += "aaaa ab cd \"xy\nz\" aaa aab\n";
+    for ( std::size_t most : { 1, 7, 4096, 100000 } ) ok = ok && check(big, cuts(big.size(), most, random));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#include LEXER
+
+#include <iostream>
+#include <sstream>
+
+struct Lexed {
+    std::vector<Lexer::Token> Tokens;
+    std::vector<Lexer::Diagnostic> Diagnostics;
+};
+
+Lexed lexAll(Lexer::Lexer& lex) {
+    Lexed lexed;
+    for ( auto& token : lex ) lexed.Tokens.push_back(token);
+    lexed.Diagnostics = lex.diagnostics();
+    return lexed;
+}
+
+bool same(const std::vector<Lexer::Token>& a, const std::vector<Lexer::Token>& b) {
+    if ( a.size() != b.size() ) return false;
+    for ( std::size_t i = 0; i < a.size(); i++ ) {
+        if ( a[i].Id != b[i].Id || a[i].Offset != b[i].Offset || a[i].Length != b[i].Length ) return false;
+    }
+    return true;
+}
+
+bool same(const Lexed& a, const Lexed& b) {
+    if ( !same(a.Tokens, b.Tokens) || a.Diagnostics.size() != b.Diagnostics.size() ) return false;
+    for ( std::size_t i = 0; i < a.Diagnostics.size(); i++ ) {
+        if ( !same({ a.Diagnostics[i].Error }, { b.Diagnostics[i].Error }) || a.Diagnostics[i].Message != b.Diagnostics[i].Message ) return false;
+    }
+    return true;
+}
+
+// recovering from errors in a stream has to give the same error tokens as in memory,
+// also when a run of bad bytes crosses the end of the stream's buffer,
+// and the static lex() functions have to hand over the same diagnostics as a lexer of its own
+bool check(const std::string& input, std::size_t errors) {
+    std::istringstream stream(input), again(input);
+    Lexer::Lexer streaming(stream), whole{ std::string_view(input) };
+    auto streamed = lexAll(streaming);
+    auto expected = lexAll(whole);
+    Lexed once, onceStreamed, parallel;
+    once.Tokens = Lexer::Lexer::lex(input, once.Diagnostics);
+    onceStreamed.Tokens = Lexer::Lexer::lex(again, onceStreamed.Diagnostics);
+    parallel.Tokens = Lexer::Lexer::lex(input, 4, parallel.Diagnostics);
+    if ( !same(streamed, expected) || !same(once, expected) || !same(onceStreamed, expected) || !same(parallel, expected) ) {
+        std::cerr << "recover: tokens differ for an input of " << input.size() << " bytes" << std::endl;
+        return false;
+    }
+    auto expectedErrors = expected.Diagnostics;
+    if ( expectedErrors.size() != errors ) {
+        std::cerr << "recover: " << expectedErrors.size() << " errors instead of " << errors << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    // one byte short of the stream buffer, so the bad bytes start right before its end
+    std::string words;
+    for ( int i = 0; i < 21840; i++ ) words += "ab ";
+    bool resync = Lexer::tables::recovery == Lexer::Recovery::Resync;
+    bool ok = check(words + std::string(100, '#') + " ab", resync ? 1 : 100)
+        && check("ab ## ab", resync ? 1 : 2)
+        && check("ab ###", resync ? 1 : 3)
+        && check(words + "#", 1)
+        && check("ab ! ab!", 2)
+        && check(words + words + words + words + "!" + words + "#" + words, 2);
+    return ok ? 0 : 1;
+}
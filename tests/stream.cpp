@@ -0,0 +1,31 @@
+#include "common.h"
+
+#include <iostream>
+#include <sstream>
+
+// lexing a stream has to give the same tokens as lexing the same input from memory,
+// also when the last token is still open at the end of the stream
+bool check(const std::string& input) {
+    std::istringstream stream(input);
+    auto streamed = Lexer::Lexer::lex(stream);
+    auto expected = lexed(input);
+    bool same = streamed.size() == expected.size();
+    for ( std::size_t i = 0; same && i < expected.size(); i++ ) {
+        same = streamed[i].Id == expected[i].Id && streamed[i].Offset == expected[i].Offset && streamed[i].Length == expected[i].Length;
+    }
+    if ( !same ) std::cerr << "stream: tokens differ for an input of " << input.size() << " bytes" << std::endl;
+    return same;
+}
+
+int main() {
+    std::string big;
+    while ( big.size() < 200000 ) big += "lorem ipsum dolor ";
+    bool ok = check("foo bar") && check("foo bar ") && check("x") && check(big + "sit") && check(big);
+    std::istringstream stream("foo bar");
+    auto tokens = Lexer::Lexer::lex(stream);
+    if ( tokens.size() != 2 || tokens[1].Offset != 4 || tokens[1].Length != 3 ) {
+        std::cerr << "stream: wrong last token" << std::endl;
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}